@@ -0,0 +1,321 @@
+// BatchScoring.cpp
+#include "BatchScoring.h"
+#include "BoundedQueue.h"
+#include "RecursiveConditioning.h"
+#include "CompiledNetwork.h"
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <memory>
+
+// Splits a CSV line on commas, honouring double quotes ("a,b" and "" escapes)
+std::vector<std::string> splitCSVLine(const std::string& line) {
+    std::vector<std::string> fields;
+    std::string field;
+    bool in_quotes = false;
+    for (size_t i = 0; i < line.size(); ++i) {
+        char c = line[i];
+        if (in_quotes) {
+            if (c == '"' && i + 1 < line.size() && line[i + 1] == '"') {
+                field += '"';
+                ++i;
+            } else if (c == '"') {
+                in_quotes = false;
+            } else {
+                field += c;
+            }
+        } else if (c == '"') {
+            in_quotes = true;
+        } else if (c == ',') {
+            fields.push_back(trim(field));
+            field.clear();
+        } else if (c != '\r') {
+            field += c;
+        }
+    }
+    fields.push_back(trim(field));
+    return fields;
+}
+
+// Missing values: empty field, "?", "NA" or "*"
+bool isMissingValue(const std::string& field) {
+    return field.empty() || field == "?" || field == "NA" || field == "*";
+}
+
+// Resolves the header once: every column named after a network variable gets the
+// dictionary of its values, so rows only need a hash lookup per field
+CaseColumns mapCaseColumns(const BayesianNetwork& bn, const std::vector<std::string>& header) {
+    CaseColumns columns;
+    for (const std::string& column_name : header) {
+        auto it = bn.variables.find(column_name);
+        std::unordered_map<std::string, int> values;
+        if (it == bn.variables.end()) {
+            std::cerr << "Warning: column " << column_name << " is not a network variable, ignoring it" << std::endl;
+            columns.variable_ids.push_back(-1);
+        } else {
+            columns.variable_ids.push_back(it->second.id);
+            for (size_t i = 0; i < it->second.values.size(); ++i) {
+                values[it->second.values[i]] = static_cast<int>(i);
+            }
+        }
+        columns.value_index.push_back(values);
+    }
+    return columns;
+}
+
+bool parseCaseRow(const CaseColumns& columns, const std::string& line, std::vector<int>& observed) {
+    std::fill(observed.begin(), observed.end(), -1);
+    std::vector<std::string> fields = splitCSVLine(line);
+    if (fields.size() != columns.variable_ids.size()) {
+        return false;
+    }
+    for (size_t c = 0; c < fields.size(); ++c) {
+        int id = columns.variable_ids[c];
+        if (id < 0 || isMissingValue(fields[c])) continue;
+        auto it = columns.value_index[c].find(fields[c]);
+        if (it == columns.value_index[c].end()) {
+            return false;
+        }
+        observed[id] = it->second;
+    }
+    return true;
+}
+
+namespace {
+
+struct CaseBatch {
+    long long sequence = 0;
+    long long first_row = 0;
+    std::vector<std::string> lines;
+};
+
+struct ScoredBatch {
+    long long sequence = 0;
+    long long invalid_rows = 0;
+    std::string text;
+};
+
+// Limits the number of batches between the reader and the writer, so that a slow batch
+// cannot make the writer buffer an unbounded number of results waiting for it
+class InFlightLimiter {
+public:
+    explicit InFlightLimiter(size_t limit) : limit_(limit > 0 ? limit : 1) {}
+
+    void acquire() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        released_.wait(lock, [this] { return in_flight_ < limit_; });
+        ++in_flight_;
+    }
+
+    void release() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        --in_flight_;
+        released_.notify_one();
+    }
+
+private:
+    size_t limit_;
+    size_t in_flight_ = 0;
+    std::mutex mutex_;
+    std::condition_variable released_;
+};
+
+// Inference for one worker thread: each worker owns its engine, since the RC caches are not shared
+class CaseScorer {
+public:
+    // compiled is shared by all the workers (read-only), null for the RC engine
+    // cache_budget: this worker's share of the RC cache budget
+    CaseScorer(const BayesianNetwork& bn, const CompiledNetwork* compiled, const ScoringOptions& options, long long cache_budget)
+        : compiled_(compiled) {
+        if (options.engine == "rc") {
+            rc_engine_.reset(new RecursiveConditioningEngine(bn, cache_budget));
+        } else {
+            enumeration_engine_.reset(new EnumerationEngine(*compiled_));
+            evidence_.reserve(compiled_->size());
+            posteriors_.resize(compiled_->posteriorSize());
+        }
+    }
+
+    void score(const std::vector<int>& observed, const std::vector<int>& query_ids, std::vector<std::vector<double>>& marginals) {
+        if (rc_engine_) {
+            rc_engine_->computeMarginals(observed, query_ids, marginals);
+            return;
+        }
+
+        evidence_.clear();
+        for (size_t id = 0; id < observed.size(); ++id) {
+            if (observed[id] >= 0) {
+                evidence_.push_back({static_cast<int>(id), observed[id]});
+            }
+        }
+        enumeration_engine_->query(evidence_.data(), evidence_.size(), posteriors_.data());
+        for (int id : query_ids) {
+            const double* first = posteriors_.data() + compiled_->posterior_offset[id];
+            marginals[id].assign(first, first + compiled_->cardinality[id]);
+        }
+    }
+
+private:
+    std::unique_ptr<RecursiveConditioningEngine> rc_engine_;
+    const CompiledNetwork* compiled_;
+    std::unique_ptr<EnumerationEngine> enumeration_engine_;
+    std::vector<EvidenceHandle> evidence_;
+    std::vector<double> posteriors_;
+};
+
+void scoringWorker(const BayesianNetwork& bn, const CompiledNetwork* compiled, const ScoringOptions& options, long long cache_budget, const CaseColumns& columns,
+                   const std::vector<int>& query_ids, BoundedQueue<CaseBatch>& work, BoundedQueue<ScoredBatch>& results) {
+    CaseScorer scorer(bn, compiled, options, cache_budget);
+    std::vector<int> observed(bn.next_id, -1);
+    std::vector<std::vector<double>> marginals(bn.next_id);
+
+    CaseBatch batch;
+    while (work.pop(batch)) {
+        ScoredBatch scored;
+        scored.sequence = batch.sequence;
+        std::ostringstream out;
+        out.precision(8);
+        for (size_t i = 0; i < batch.lines.size(); ++i) {
+            out << batch.first_row + static_cast<long long>(i);
+            if (!parseCaseRow(columns, batch.lines[i], observed)) {
+                ++scored.invalid_rows;
+                for (int id : query_ids) {
+                    for (size_t v = 0; v < bn.variables.at(bn.id_to_name.at(id)).values.size(); ++v) out << ",";
+                }
+            } else {
+                scorer.score(observed, query_ids, marginals);
+                for (int id : query_ids) {
+                    for (double p : marginals[id]) out << "," << p;
+                }
+            }
+            out << "\n";
+        }
+        scored.text = out.str();
+        results.push(std::move(scored));
+    }
+}
+
+} // namespace
+
+bool scoreCaseFile(const BayesianNetwork& bn, const std::string& cases_file, const std::string& output_file,
+                   const ScoringOptions& options, ScoringStats* stats) {
+    auto start_time = std::chrono::steady_clock::now();
+
+    std::ifstream input(cases_file);
+    if (!input.is_open()) {
+        std::cerr << "Error: Could not open file " << cases_file << std::endl;
+        return false;
+    }
+    std::ofstream output(output_file);
+    if (!output.is_open()) {
+        std::cerr << "Error: Could not create file " << output_file << std::endl;
+        return false;
+    }
+
+    std::string line;
+    if (!std::getline(input, line)) {
+        std::cerr << "Error: " << cases_file << " is empty" << std::endl;
+        return false;
+    }
+    CaseColumns columns = mapCaseColumns(bn, splitCSVLine(line));
+
+    // Posterior columns, in the order of the query variables (all variables by default)
+    std::vector<int> query_ids;
+    if (options.query_variables.empty()) {
+        for (const auto& pair : bn.variables) query_ids.push_back(pair.second.id);
+    } else {
+        for (const std::string& name : options.query_variables) {
+            auto it = bn.variables.find(name);
+            if (it == bn.variables.end()) {
+                std::cerr << "Error: unknown query variable " << name << std::endl;
+                return false;
+            }
+            query_ids.push_back(it->second.id);
+        }
+    }
+    output << "row";
+    for (int id : query_ids) {
+        const Variable& var = bn.variables.at(bn.id_to_name.at(id));
+        for (const std::string& value : var.values) {
+            output << ",P(" << var.name << "=" << value << ")";
+        }
+    }
+    output << "\n";
+
+    int threads = options.threads > 0 ? options.threads : static_cast<int>(std::thread::hardware_concurrency());
+    if (threads <= 0) threads = 1;
+    size_t max_in_flight = options.max_batches_in_flight > 0 ? options.max_batches_in_flight : 4 * static_cast<size_t>(threads);
+    size_t batch_size = options.batch_size > 0 ? options.batch_size : 1;
+
+    // reader (this thread) -> workers -> writer
+    BoundedQueue<CaseBatch> work(max_in_flight);
+    BoundedQueue<ScoredBatch> results(max_in_flight);
+    InFlightLimiter limiter(max_in_flight);
+
+    // La rete compilata e' in sola lettura: una copia per tutti i worker
+    CompiledNetwork compiled;
+    if (options.engine != "rc") compiled = compileNetwork(bn);
+
+    // Il budget delle cache RC e' complessivo: ogni worker ne ha una quota uguale
+    long long cache_budget = (options.mem_limit >= 0 ? options.mem_limit : DEFAULT_CACHE_BUDGET_BYTES) / threads;
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.push_back(std::thread(scoringWorker, std::cref(bn), options.engine != "rc" ? &compiled : nullptr, std::cref(options), cache_budget, std::cref(columns),
+                                      std::cref(query_ids), std::ref(work), std::ref(results)));
+    }
+
+    long long invalid_rows = 0;
+    std::thread writer([&]() {
+        std::map<long long, ScoredBatch> pending; // risultati arrivati prima del loro turno
+        long long next_sequence = 0;
+        ScoredBatch scored;
+        while (results.pop(scored)) {
+            pending[scored.sequence] = std::move(scored);
+            for (auto it = pending.find(next_sequence); it != pending.end(); it = pending.find(next_sequence)) {
+                output << it->second.text;
+                invalid_rows += it->second.invalid_rows;
+                pending.erase(it);
+                ++next_sequence;
+                limiter.release();
+            }
+        }
+    });
+
+    long long rows = 0;
+    long long batches = 0;
+    CaseBatch batch;
+    while (std::getline(input, line)) {
+        if (trim(line).empty()) continue;
+        if (batch.lines.empty()) {
+            batch.first_row = rows;
+        }
+        batch.lines.push_back(line);
+        ++rows;
+        if (batch.lines.size() == batch_size) {
+            batch.sequence = batches++;
+            limiter.acquire();
+            work.push(std::move(batch));
+            batch = CaseBatch();
+        }
+    }
+    if (!batch.lines.empty()) {
+        batch.sequence = batches++;
+        limiter.acquire();
+        work.push(std::move(batch));
+    }
+
+    work.close();
+    for (std::thread& worker : workers) worker.join();
+    results.close();
+    writer.join();
+
+    if (stats) {
+        stats->rows = rows;
+        stats->invalid_rows = invalid_rows;
+        stats->batches = batches;
+        stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    }
+    return true;
+}
@@ -0,0 +1,42 @@
+#ifndef BATCH_SCORING_H
+#define BATCH_SCORING_H
+
+#include "BayesianNetwork.h"
+#include <unordered_map>
+
+// Options for the streaming scoring of a case file (one CSV row per case)
+struct ScoringOptions {
+    std::string engine = "rc";                    // "rc" or "enumeration"
+    long long mem_limit = -1;                     // cache budget for "rc" shared by all the workers, -1 = DEFAULT_CACHE_BUDGET_BYTES
+    int threads = 0;                              // worker threads, 0 = hardware concurrency
+    size_t batch_size = 256;                      // rows per unit of work
+    size_t max_batches_in_flight = 0;             // read-ahead limit, 0 = 4 batches per worker
+    std::vector<std::string> query_variables;     // posterior columns to write, empty = all variables
+};
+
+struct ScoringStats {
+    long long rows = 0;
+    long long invalid_rows = 0;                   // wrong number of fields or unknown values
+    long long batches = 0;
+    double seconds = 0.0;
+};
+
+// Mapping of the columns of a case file to the network, resolved once from the header
+struct CaseColumns {
+    std::vector<int> variable_ids;                                   // per column, -1 if not a network variable
+    std::vector<std::unordered_map<std::string, int>> value_index;   // per column: value string -> value index
+};
+
+// --- CSV helpers (shared with parameter learning) ---
+std::vector<std::string> splitCSVLine(const std::string& line);
+CaseColumns mapCaseColumns(const BayesianNetwork& bn, const std::vector<std::string>& header);
+bool isMissingValue(const std::string& field);
+// Fills observed[id] with the value index of each column (-1 if missing). Returns false on invalid rows.
+bool parseCaseRow(const CaseColumns& columns, const std::string& line, std::vector<int>& observed);
+
+// Scores every row of cases_file and writes P(X = x | row) for the query variables to output_file,
+// keeping the original row order. Reading, inference and writing run as a bounded pipeline.
+bool scoreCaseFile(const BayesianNetwork& bn, const std::string& cases_file, const std::string& output_file,
+                   const ScoringOptions& options, ScoringStats* stats = nullptr);
+
+#endif // BATCH_SCORING_H
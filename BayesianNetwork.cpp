@@ -1,8 +1,11 @@
 // src/BayesianNetwork.cpp
 #include "BayesianNetwork.h" // Include se stesso per le dichiarazioni
+#include "CompiledNetwork.h"
 #include <iostream>
 #include <fstream>
 #include <algorithm> // For std::replace in parseBIF, and possibly trim() if implemented with algorithms
+#include <cctype>
+#include <iterator>
 
 // Helper function to trim whitespace from a string
 std::string trim(const std::string& str) {
@@ -30,6 +33,298 @@ Evidence parseEvidenceString(const std::string& evidence_str) {
     return evidence;
 }
 
+// Converte l'evidenza in un vettore indicizzato per ID (-1 = non osservata)
+std::vector<int> evidenceToValues(const BayesianNetwork& bn, const Evidence& evidence) {
+    std::vector<int> observed(bn.next_id, -1);
+    for (const auto& e_pair : evidence) {
+        auto it = bn.variables.find(e_pair.first);
+        if (it == bn.variables.end()) {
+            std::cerr << "Error: evidence on unknown variable " << e_pair.first << std::endl;
+            continue;
+        }
+        int value_idx = findValueIndex(it->second, e_pair.second);
+        if (value_idx < 0) {
+            std::cerr << "Error: unknown value " << e_pair.second << " for variable " << e_pair.first << std::endl;
+            continue;
+        }
+        observed[it->second.id] = value_idx;
+    }
+    return observed;
+}
+
+// Parses a memory size like "512M", "2G", "64k" or a plain byte count. Returns -1 if invalid
+long long parseMemorySize(const std::string& size_str) {
+    std::string str = trim(size_str);
+    if (str.empty()) return -1;
+
+    long long multiplier = 1;
+    char suffix = static_cast<char>(std::toupper(static_cast<unsigned char>(str.back())));
+    if (suffix == 'K' || suffix == 'M' || suffix == 'G') {
+        multiplier = suffix == 'K' ? (1LL << 10) : suffix == 'M' ? (1LL << 20) : (1LL << 30);
+        str.pop_back();
+    }
+    try {
+        size_t parsed = 0;
+        double amount = std::stod(str, &parsed);
+        if (parsed != str.size() || amount < 0) return -1;
+        return static_cast<long long>(amount * multiplier);
+    } catch (const std::exception& e) {
+        return -1;
+    }
+}
+
+// Returns the index of `value` among the values of `var`, or -1 if it is not one of them
+int findValueIndex(const Variable& var, const std::string& value) {
+    for (size_t i = 0; i < var.values.size(); ++i) {
+        if (var.values[i] == value) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+// Parses a comma separated list of probabilities like "0.8, 0.2"
+static std::vector<double> parseProbabilityList(const std::string& list_str) {
+    std::vector<double> probs;
+    std::stringstream ss(list_str);
+    std::string prob_str;
+    while (std::getline(ss, prob_str, ',')) {
+        std::string trimmed_prob = trim(prob_str);
+        if (trimmed_prob.empty()) continue;
+        try {
+            probs.push_back(std::stod(trimmed_prob));
+        } catch (const std::exception& e) {
+            std::cerr << "Invalid probability value: " << trimmed_prob << std::endl;
+        }
+    }
+    return probs;
+}
+
+// Converts a tuple of parent values like "true, false" (in the order of target.parents)
+// into the CPT row index, first parent most significant. Returns -1 if the tuple does not match.
+static long long parseParentTuple(const BayesianNetwork& bn, const Variable& target, const std::string& tuple_str) {
+    std::vector<std::string> tuple_values;
+    std::stringstream ss(tuple_str);
+    std::string value;
+    while (std::getline(ss, value, ',')) {
+        tuple_values.push_back(trim(value));
+    }
+    if (tuple_values.size() != target.parents.size()) {
+        return -1;
+    }
+
+    long long row = 0;
+    for (size_t i = 0; i < target.parents.size(); ++i) {
+        auto it = bn.variables.find(target.parents[i]);
+        if (it == bn.variables.end()) return -1;
+        int value_idx = findValueIndex(it->second, tuple_values[i]);
+        if (value_idx < 0) return -1;
+        row = row * static_cast<long long>(it->second.values.size()) + value_idx;
+    }
+    return row;
+}
+
+// Parses a context like "a = true, c = false" into (parent position, value index) pairs
+static bool parseRuleContext(const BayesianNetwork& bn, const Variable& target, const std::string& context_str,
+                             std::vector<std::pair<int, int>>& context) {
+    std::stringstream ss(context_str);
+    std::string assignment;
+    while (std::getline(ss, assignment, ',')) {
+        size_t eq_pos = assignment.find("=");
+        if (eq_pos == std::string::npos) return false;
+        std::string parent_name = trim(assignment.substr(0, eq_pos));
+        std::string parent_value = trim(assignment.substr(eq_pos + 1));
+
+        auto pos = std::find(target.parents.begin(), target.parents.end(), parent_name);
+        if (pos == target.parents.end()) return false;
+        int value_idx = findValueIndex(bn.variables.at(parent_name), parent_value);
+        if (value_idx < 0) return false;
+        context.push_back(std::make_pair(static_cast<int>(pos - target.parents.begin()), value_idx));
+    }
+    return true;
+}
+
+// Statement naming the representation of a compact probability block
+static bool isRepresentationStatement(const std::string& statement) {
+    return statement.rfind("noisy-or", 0) == 0 || statement.rfind("noisy-max", 0) == 0 ||
+           statement == "tree" || statement == "sparse";
+}
+
+// True if one of the ';'-separated statements of a probability block names a compact representation
+static bool containsRepresentationStatement(const std::string& raw_data) {
+    std::stringstream ss(raw_data.substr(0, raw_data.find("}")));
+    std::string statement;
+    while (std::getline(ss, statement, ';')) {
+        if (isRepresentationStatement(trim(statement))) return true;
+    }
+    return false;
+}
+
+// Parses the body of a compact probability block into target.cpt_kind/cpt_params/cpt_index.
+// Supported statements (separated by ';'):
+//   noisy-or p1, p2, ...;     link probability of each parent, in declaration order
+//   noisy-max;                then "(parent = value) d1, ..., dk;" for every active parent state
+//   tree;                     then "(p1 = v1, p2 = v2) d1, ..., dk;" rules, first match wins
+//   sparse;                   then "(v1, v2, ...) d1, ..., dk;" rows, zero entries are dropped
+//   leak ...;                 noisy-or: P(child = first value); noisy-max: full distribution
+//   default d1, ..., dk;      tree: fallback rule; sparse: row used for unlisted configurations
+// The statements can come in any order: the representation is read first.
+static void parseCompactCPT(BayesianNetwork& bn, const std::string& target_name, const std::string& raw_data) {
+    Variable& target = bn.variables[target_name];
+    const size_t card = target.values.size();
+
+    std::string data = raw_data;
+    size_t brace_pos = data.find("}");
+    if (brace_pos != std::string::npos) {
+        data.erase(brace_pos);
+    }
+
+    std::vector<double> absent(card, 0.0);
+    if (card > 0) absent[card - 1] = 1.0;
+    std::vector<double> leak = absent; // default: leak cause never active
+    std::vector<std::vector<std::vector<double>>> links; // noisy: [parent][parent value][child value]
+    std::vector<std::vector<std::pair<int, int>>> rule_contexts;
+    std::vector<std::vector<double>> rule_distributions;
+    std::vector<double> default_row;
+    std::vector<std::pair<long long, double>> sparse_entries;
+    std::vector<long long> sparse_rows;
+
+    target.cpt.clear();
+    target.cpt_params.clear();
+    target.cpt_index.clear();
+
+    std::vector<std::string> statements;
+    std::stringstream ss(data);
+    std::string statement;
+    while (std::getline(ss, statement, ';')) {
+        statement = trim(statement);
+        if (!statement.empty()) statements.push_back(statement);
+    }
+    // La dichiarazione del tipo decide come leggere le altre, ovunque si trovi nel blocco
+    std::stable_partition(statements.begin(), statements.end(), isRepresentationStatement);
+
+    for (const std::string& statement : statements) {
+        if (statement.rfind("noisy-or", 0) == 0 || statement.rfind("noisy-max", 0) == 0) {
+            bool noisy_or = statement.rfind("noisy-or", 0) == 0;
+            target.cpt_kind = noisy_or ? CPTKind::NoisyOR : CPTKind::NoisyMAX;
+
+            // Every parent state starts as "absent": it never raises the child's degree
+            links.assign(target.parents.size(), std::vector<std::vector<double>>());
+            for (size_t i = 0; i < target.parents.size(); ++i) {
+                size_t parent_card = bn.variables[target.parents[i]].values.size();
+                links[i].assign(parent_card, absent);
+            }
+
+            if (noisy_or) {
+                if (card != 2) {
+                    std::cerr << "Warning: noisy-or expects a binary variable, " << target_name << " has " << card << " values" << std::endl;
+                }
+                std::vector<double> link_probs = parseProbabilityList(statement.substr(8));
+                if (link_probs.size() != target.parents.size()) {
+                    std::cerr << "Error: noisy-or for " << target_name << " needs one link probability per parent" << std::endl;
+                }
+                for (size_t i = 0; i < target.parents.size() && i < link_probs.size(); ++i) {
+                    // All non-absent parent values cause the child with the same probability
+                    for (size_t s = 0; s + 1 < links[i].size(); ++s) {
+                        links[i][s].assign(card, 0.0);
+                        links[i][s][0] = link_probs[i];
+                        links[i][s][card - 1] += 1.0 - link_probs[i];
+                    }
+                }
+            }
+        } else if (statement == "tree") {
+            target.cpt_kind = CPTKind::Tree;
+        } else if (statement == "sparse") {
+            target.cpt_kind = CPTKind::Sparse;
+        } else if (statement.rfind("leak", 0) == 0) {
+            std::vector<double> leak_probs = parseProbabilityList(statement.substr(4));
+            if (target.cpt_kind == CPTKind::NoisyOR && leak_probs.size() == 1 && card == 2) {
+                leak = {leak_probs[0], 1.0 - leak_probs[0]};
+            } else if (leak_probs.size() == card) {
+                leak = leak_probs;
+            } else {
+                std::cerr << "Error: invalid leak for " << target_name << std::endl;
+            }
+        } else if (statement.rfind("default", 0) == 0) {
+            default_row = parseProbabilityList(statement.substr(7));
+            if (default_row.size() != card) {
+                std::cerr << "Error: default row for " << target_name << " has " << default_row.size() << " values" << std::endl;
+                default_row.clear();
+            }
+        } else if (statement.rfind("(", 0) == 0 && statement.find(")") != std::string::npos) {
+            size_t close_paren = statement.find(")");
+            std::string context_str = statement.substr(1, close_paren - 1);
+            std::vector<double> dist = parseProbabilityList(statement.substr(close_paren + 1));
+            if (dist.size() != card) {
+                std::cerr << "Error: entry '" << statement << "' for " << target_name << " needs " << card << " probabilities" << std::endl;
+                continue;
+            }
+
+            std::vector<std::pair<int, int>> context;
+            if (target.cpt_kind == CPTKind::Sparse) {
+                long long row = parseParentTuple(bn, target, context_str);
+                if (row < 0) {
+                    std::cerr << "Error: unknown parent configuration (" << context_str << ") for " << target_name << std::endl;
+                    continue;
+                }
+                sparse_rows.push_back(row);
+                for (size_t v = 0; v < card; ++v) {
+                    if (dist[v] != 0.0) {
+                        sparse_entries.push_back(std::make_pair(row * static_cast<long long>(card) + static_cast<long long>(v), dist[v]));
+                    }
+                }
+            } else if (!parseRuleContext(bn, target, context_str, context)) {
+                std::cerr << "Error: invalid context (" << context_str << ") for " << target_name << std::endl;
+            } else if (target.cpt_kind == CPTKind::NoisyMAX) {
+                if (context.size() != 1) {
+                    std::cerr << "Error: noisy-max entries take exactly one parent state, got (" << context_str << ")" << std::endl;
+                    continue;
+                }
+                links[context[0].first][context[0].second] = dist;
+            } else if (target.cpt_kind == CPTKind::Tree) {
+                rule_contexts.push_back(context);
+                rule_distributions.push_back(dist);
+            }
+        } else {
+            std::cerr << "Warning: ignoring statement '" << statement << "' in probability block of " << target_name << std::endl;
+        }
+    }
+
+    // Flatten the parsed representation into cpt_params/cpt_index
+    if (target.cpt_kind == CPTKind::NoisyOR || target.cpt_kind == CPTKind::NoisyMAX) {
+        target.cpt_params = leak;
+        for (const auto& parent_links : links) {
+            for (const auto& dist : parent_links) {
+                target.cpt_params.insert(target.cpt_params.end(), dist.begin(), dist.end());
+            }
+        }
+    } else if (target.cpt_kind == CPTKind::Tree) {
+        if (!default_row.empty()) {
+            rule_contexts.push_back(std::vector<std::pair<int, int>>());
+            rule_distributions.push_back(default_row);
+        }
+        for (size_t r = 0; r < rule_contexts.size(); ++r) {
+            target.cpt_index.push_back(static_cast<long long>(rule_contexts[r].size()));
+            for (const auto& assignment : rule_contexts[r]) {
+                target.cpt_index.push_back(assignment.first);
+                target.cpt_index.push_back(assignment.second);
+            }
+            target.cpt_params.insert(target.cpt_params.end(), rule_distributions[r].begin(), rule_distributions[r].end());
+        }
+    } else if (target.cpt_kind == CPTKind::Sparse) {
+        std::sort(sparse_rows.begin(), sparse_rows.end());
+        sparse_rows.erase(std::unique(sparse_rows.begin(), sparse_rows.end()), sparse_rows.end());
+        std::sort(sparse_entries.begin(), sparse_entries.end());
+
+        target.cpt_params = default_row.empty() ? std::vector<double>(card, 0.0) : default_row;
+        target.cpt_index.push_back(static_cast<long long>(sparse_rows.size()));
+        target.cpt_index.insert(target.cpt_index.end(), sparse_rows.begin(), sparse_rows.end());
+        for (const auto& entry : sparse_entries) {
+            target.cpt_index.push_back(entry.first);
+            target.cpt_params.push_back(entry.second);
+        }
+    }
+}
 
 // Function to parse the BIF file
 BayesianNetwork parseBIF(const std::string& filename) {
@@ -161,6 +456,28 @@ BayesianNetwork parseBIF(const std::string& filename) {
             // }
             // std::cout << std::endl;
         }
+        // Compact CPT blocks (noisy-or, noisy-max, tree, sparse), also when the block opens with leak or default
+        else if (current_block_type == "probability" &&
+                 (line.rfind("noisy-or", 0) == 0 || line.rfind("noisy-max", 0) == 0 ||
+                  line.rfind("tree", 0) == 0 || line.rfind("sparse", 0) == 0 ||
+                  line.rfind("leak", 0) == 0 || line.rfind("default", 0) == 0)) {
+            std::string raw_data = line;
+            bool block_closed = (line.find("}") != std::string::npos);
+            while (!block_closed && std::getline(file, line)) {
+                std::string next_cleaned_line = trim(line);
+                if (next_cleaned_line.empty() || next_cleaned_line.rfind("//", 0) == 0) continue;
+
+                raw_data += " " + next_cleaned_line;
+                if (next_cleaned_line.find("}") != std::string::npos) {
+                    block_closed = true;
+                }
+            }
+            parseCompactCPT(bn, current_prob_target, raw_data);
+
+            // The closing '}' has been consumed together with the block
+            current_block_type = "";
+            current_prob_target = "";
+        }
         // If there are conditional values (e.g., (true) 0.8, 0.2;)
          else if (line.rfind("(", 0) == 0 && current_block_type == "probability") {
             // Questo blocco intercetta una riga che inizia direttamente con una tupla condizionale, 
@@ -182,85 +499,59 @@ BayesianNetwork parseBIF(const std::string& filename) {
                 }
             }
 
+            // Blocco compatto che inizia con una regola o una voce: "tree;" o "sparse;" arrivano dopo
+            if (containsRepresentationStatement(raw_data)) {
+                parseCompactCPT(bn, current_prob_target, raw_data);
+                current_block_type = "";
+                current_prob_target = "";
+                continue;
+            }
+
             // --- Pulizia e Normalizzazione della stringa unica ---
             std::string normalized_data = raw_data;
-            
-            // 1. Sostituisci ; con ,
-            std::replace(normalized_data.begin(), normalized_data.end(), ';', ',');
-            
-            // 2. Rimuovi tutte le sezioni comprese tra parentesi tonde (es. (true, false))
-            size_t open_paren = normalized_data.find("(");
-            while (open_paren != std::string::npos) {
-                size_t close_paren = normalized_data.find(")", open_paren);
-                if (close_paren != std::string::npos) {
-                    // Rimuove la tupla condizionale e le parentesi
-                    normalized_data.erase(open_paren, close_paren - open_paren + 1);
-                }
-                open_paren = normalized_data.find("(");
-            }
-            
-            // 3. Rimuovi la '}' di chiusura del blocco
+
+            // 1. Rimuovi la '}' di chiusura del blocco
             size_t brace_pos = normalized_data.find("}");
             if (brace_pos != std::string::npos) {
                 normalized_data.erase(brace_pos);
             }
-            
-            // 4. Estrazione finale dei valori (usando la virgola come separatore)
-            std::stringstream ss_data(normalized_data);
-            std::string prob_str;
-            std::vector<double> all_cpt_values;
-            
-            while (std::getline(ss_data, prob_str, ',')) {
-                std::string trimmed_prob = trim(prob_str);
-                if (trimmed_prob.empty()) continue;
-                
-                try {
-                    all_cpt_values.push_back(std::stod(trimmed_prob));
-                } catch (const std::exception& e) {
-                    // Ignora
-                }
-            }
 
-            // 5. Aggiungi i valori alla CPT della variabile corrente.
-            // NOTA: Con questo approccio, tutti i valori finiscono in UN'UNICA riga della CPT,
-            // cosa non corretta per il BIF, che richiede una riga CPT per ogni configurazione dei genitori.
+            // 2. Ogni voce "(v1, v2, ...) p1, p2, ...;" diventa la riga della CPT che corrisponde
+            // alla tupla dei genitori, cosi' l'ordine delle righe nel file non conta. Ogni riga
+            // ha tante probabilita' quanti sono i valori della variabile target.
+            Variable& target = bn.variables[current_prob_target];
+            const size_t PROB_COUNT_PER_ROW = target.values.size();
 
-            const size_t PROB_COUNT_PER_ROW = 2;
+            size_t row_count = 1;
+            for (const std::string& parent_name : target.parents) {
+                row_count *= bn.variables[parent_name].values.size();
+            }
 
             // Resetta la CPT per evitare di mescolare dati in caso di esecuzione multipla o parsing complesso.
-            bn.variables[current_prob_target].cpt.clear();
-
-            if (!all_cpt_values.empty())
-            {
-
-                // Il contatore 'i' scorre l'array appiattito 'all_cpt_values' a passi di 2
-                for (size_t i = 0; i < all_cpt_values.size(); i += PROB_COUNT_PER_ROW)
-                {
-
-                    // La variabile 'cpt_row_index' tiene traccia della riga CPT che stai costruendo (i/2)
-                    // size_t cpt_row_index = i / PROB_COUNT_PER_ROW;
-
-                    // Verifica che ci siano almeno due elementi nel blocco
-                    if (i + 1 < all_cpt_values.size())
-                    {
-
-                        // 1. Creiamo la nuova riga CPT usando l'inizializzazione uniforme (la più pulita)
-                        std::vector<double> new_row = {
-                            all_cpt_values[i],
-                            all_cpt_values[i + 1]};
-
-                        // 2. Aggiungiamo la riga alla matrice CPT. Questa operazione inserisce
-                        // la riga all'indice 'i/2' in modo sicuro.
-                        bn.variables[current_prob_target].cpt.push_back(new_row);
+            target.cpt.clear();
+            target.cpt.resize(row_count);
+
+            std::stringstream ss_entries(normalized_data);
+            std::string entry;
+            size_t sequential_row = 0;
+            while (std::getline(ss_entries, entry, ';')) {
+                entry = trim(entry);
+                size_t open_paren = entry.find("(");
+                size_t close_paren = entry.find(")");
+                if (entry.empty() || open_paren == std::string::npos || close_paren == std::string::npos) continue;
+
+                std::vector<double> new_row = parseProbabilityList(entry.substr(close_paren + 1));
+                long long row = parseParentTuple(bn, target, entry.substr(open_paren + 1, close_paren - open_paren - 1));
+                if (row < 0) {
+                    row = static_cast<long long>(sequential_row); // tupla non riconosciuta: ordine del file
+                }
+                ++sequential_row;
 
-                        // Se volessi stampare l'indice in questo momento:
-                        // std::cout << "Aggiunta riga CPT all'indice: " << i / PROB_COUNT_PER_ROW << std::endl;
-                    }
-                    else
-                    {
-                        std::cerr << "Attenzione: Ultima riga CPT incompleta per " << current_prob_target << std::endl;
-                    }
+                if (new_row.size() != PROB_COUNT_PER_ROW || row >= static_cast<long long>(row_count)) {
+                    std::cerr << "Attenzione: riga CPT incompleta o fuori range per " << current_prob_target << std::endl;
+                    continue;
                 }
+                target.cpt[row] = new_row;
             }
             // Fine Codice Corretto
         } // Fine del nuovo else if
@@ -277,6 +568,159 @@ BayesianNetwork parseBIF(const std::string& filename) {
     return bn;
 }
 
+// Writes a probability list like "0.8, 0.2"
+static void writeProbabilityList(std::ostream& out, const double* probs, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        out << (i > 0 ? ", " : "") << probs[i];
+    }
+}
+
+// Writes the parent tuple "(v1, v2, ...)" of a CPT row (first parent most significant)
+static void writeParentTuple(std::ostream& out, const BayesianNetwork& bn, const Variable& var, long long row) {
+    std::vector<std::string> tuple(var.parents.size());
+    for (size_t i = var.parents.size(); i-- > 0;) {
+        const Variable& parent = bn.variables.at(var.parents[i]);
+        long long parent_card = static_cast<long long>(parent.values.size());
+        tuple[i] = parent.values[row % parent_card];
+        row /= parent_card;
+    }
+    out << "(";
+    for (size_t i = 0; i < tuple.size(); ++i) {
+        out << (i > 0 ? ", " : "") << tuple[i];
+    }
+    out << ")";
+}
+
+// Writes the network back in BIF format (variables and CPTs in ID order), using the
+// same compact block syntax accepted by parseBIF for non-dense CPTs
+bool writeBIF(const BayesianNetwork& bn, const std::string& filename, const std::string& network_name) {
+    std::ofstream out(filename);
+    if (!out.is_open()) {
+        std::cerr << "Error: Could not create file " << filename << std::endl;
+        return false;
+    }
+    out.precision(10);
+
+    std::vector<const Variable*> variables;
+    for (int id = 0; id < bn.next_id; ++id) {
+        variables.push_back(&bn.variables.at(bn.id_to_name.at(id)));
+    }
+
+    out << "network " << network_name << " {" << std::endl << "}" << std::endl;
+    for (const Variable* var : variables) {
+        out << "variable " << var->name << " {" << std::endl;
+        out << "  type discrete [ " << var->values.size() << " ] { ";
+        for (size_t i = 0; i < var->values.size(); ++i) {
+            out << (i > 0 ? ", " : "") << var->values[i];
+        }
+        out << " };" << std::endl << "}" << std::endl;
+    }
+
+    for (const Variable* var : variables) {
+        const size_t card = var->values.size();
+        out << "probability ( " << var->name;
+        for (size_t i = 0; i < var->parents.size(); ++i) {
+            out << (i == 0 ? " | " : ", ") << var->parents[i];
+        }
+        out << " ) {" << std::endl;
+
+        switch (var->cpt_kind) {
+            case CPTKind::Dense:
+                if (var->parents.empty()) {
+                    out << "  table ";
+                    if (!var->cpt.empty()) writeProbabilityList(out, var->cpt[0].data(), var->cpt[0].size());
+                    out << ";" << std::endl;
+                    break;
+                }
+                for (size_t row = 0; row < var->cpt.size(); ++row) {
+                    out << "  ";
+                    writeParentTuple(out, bn, *var, static_cast<long long>(row));
+                    out << " ";
+                    writeProbabilityList(out, var->cpt[row].data(), var->cpt[row].size());
+                    out << ";" << std::endl;
+                }
+                break;
+
+            case CPTKind::NoisyOR:
+            case CPTKind::NoisyMAX: {
+                // params: leak[card], then a distribution per (parent, parent value)
+                size_t offset = card;
+                if (var->cpt_kind == CPTKind::NoisyOR) {
+                    out << "  noisy-or ";
+                    for (size_t i = 0; i < var->parents.size(); ++i) {
+                        out << (i > 0 ? ", " : "") << var->cpt_params[offset];
+                        offset += bn.variables.at(var->parents[i]).values.size() * card;
+                    }
+                    out << ";" << std::endl << "  leak " << var->cpt_params[0] << ";" << std::endl;
+                    break;
+                }
+                out << "  noisy-max;" << std::endl << "  leak ";
+                writeProbabilityList(out, var->cpt_params.data(), card);
+                out << ";" << std::endl;
+                for (const std::string& parent_name : var->parents) {
+                    const Variable& parent = bn.variables.at(parent_name);
+                    for (size_t s = 0; s < parent.values.size(); ++s, offset += card) {
+                        if (s + 1 == parent.values.size() && var->cpt_params[offset + card - 1] == 1.0) continue; // absent
+                        out << "  (" << parent_name << " = " << parent.values[s] << ") ";
+                        writeProbabilityList(out, var->cpt_params.data() + offset, card);
+                        out << ";" << std::endl;
+                    }
+                }
+                break;
+            }
+
+            case CPTKind::Tree: {
+                out << "  tree;" << std::endl;
+                size_t pos = 0;
+                size_t rule = 0;
+                while (pos < var->cpt_index.size()) {
+                    long long context_size = var->cpt_index[pos++];
+                    if (context_size == 0) {
+                        out << "  default ";
+                    } else {
+                        out << "  (";
+                        for (long long k = 0; k < context_size; ++k) {
+                            const std::string& parent_name = var->parents[var->cpt_index[pos + 2 * k]];
+                            out << (k > 0 ? ", " : "") << parent_name << " = "
+                                << bn.variables.at(parent_name).values[var->cpt_index[pos + 2 * k + 1]];
+                        }
+                        out << ") ";
+                    }
+                    writeProbabilityList(out, var->cpt_params.data() + rule * card, card);
+                    out << ";" << std::endl;
+                    pos += 2 * context_size;
+                    ++rule;
+                }
+                break;
+            }
+
+            case CPTKind::Sparse: {
+                out << "  sparse;" << std::endl;
+                long long listed_rows = var->cpt_index[0];
+                size_t key_pos = 1 + static_cast<size_t>(listed_rows);
+                for (long long r = 0; r < listed_rows; ++r) {
+                    long long row = var->cpt_index[1 + r];
+                    std::vector<double> probs(card, 0.0);
+                    for (; key_pos < var->cpt_index.size() && var->cpt_index[key_pos] / static_cast<long long>(card) == row; ++key_pos) {
+                        probs[var->cpt_index[key_pos] % card] = var->cpt_params[card + key_pos - 1 - listed_rows];
+                    }
+                    out << "  ";
+                    writeParentTuple(out, bn, *var, row);
+                    out << " ";
+                    writeProbabilityList(out, probs.data(), card);
+                    out << ";" << std::endl;
+                }
+                out << "  default ";
+                writeProbabilityList(out, var->cpt_params.data(), card);
+                out << ";" << std::endl;
+                break;
+            }
+        }
+        out << "}" << std::endl;
+    }
+    return true;
+}
+
 // Funzione helper ricorsiva per la DFS per l'ordinamento topologico
 // `u`: l'ID del nodo corrente da visitare
 // `bn`: la rete bayesiana che contiene il grafo
@@ -365,6 +809,98 @@ std::vector<int> topological_sort(const BayesianNetwork &bn)
 }
 
 
+// Costruisce il grafo morale della rete: archi non orientati tra ogni variabile e i suoi genitori,
+// e tra genitori della stessa variabile ("matrimonio" dei genitori). Indicizzato per ID.
+std::vector<std::set<int>> moral_graph(const BayesianNetwork& bn) {
+    std::vector<std::set<int>> neighbours(bn.next_id);
+    for (const auto& pair : bn.variables) {
+        const Variable& var = pair.second;
+        std::vector<int> family = {var.id};
+        for (const std::string& parent_name : var.parents) {
+            family.push_back(bn.name_to_id.at(parent_name));
+        }
+        for (size_t i = 0; i < family.size(); ++i) {
+            for (size_t j = i + 1; j < family.size(); ++j) {
+                if (family[i] == family[j]) continue;
+                neighbours[family[i]].insert(family[j]);
+                neighbours[family[j]].insert(family[i]);
+            }
+        }
+    }
+    return neighbours;
+}
+
+// Ordine di eliminazione greedy min-fill sul grafo morale: ad ogni passo elimina la variabile che
+// aggiunge meno archi di riempimento (a parita', quella con la famiglia di cardinalita' minore,
+// oppure, con tie_break_rng, una a caso tra quelle con meno fill-in: i restart di PlanImprover).
+std::vector<int> min_fill_elimination_order(const BayesianNetwork& bn, std::mt19937_64* tie_break_rng) {
+    std::vector<std::set<int>> neighbours = moral_graph(bn);
+    std::vector<double> cardinality(bn.next_id, 1.0);
+    for (const auto& pair : bn.variables) {
+        cardinality[pair.second.id] = static_cast<double>(pair.second.values.size());
+    }
+    // Matrice di adiacenza accanto agli insiemi: il conteggio dei fill-in fa solo accessi O(1)
+    std::vector<std::vector<char>> adjacent(bn.next_id, std::vector<char>(bn.next_id, 0));
+    for (int v = 0; v < bn.next_id; ++v) {
+        for (int a : neighbours[v]) adjacent[v][a] = 1;
+    }
+
+    std::vector<int> order;
+    std::vector<bool> eliminated(bn.next_id, false);
+    std::vector<int> around;
+    std::vector<int> candidates;
+    for (int step = 0; step < bn.next_id; ++step) {
+        int best = -1;
+        long long best_fill = 0;
+        double best_weight = 0.0;
+        candidates.clear();
+        for (int v = 0; v < bn.next_id; ++v) {
+            if (eliminated[v]) continue;
+            long long fill = 0;
+            double weight = cardinality[v];
+            around.assign(neighbours[v].begin(), neighbours[v].end());
+            for (size_t a = 0; a < around.size(); ++a) {
+                weight *= cardinality[around[a]];
+                const std::vector<char>& row = adjacent[around[a]];
+                for (size_t b = a + 1; b < around.size(); ++b) {
+                    if (!row[around[b]]) ++fill;
+                }
+            }
+            if (tie_break_rng) {
+                if (best == -1 || fill < best_fill) {
+                    best = v;
+                    best_fill = fill;
+                    candidates.clear();
+                }
+                if (fill == best_fill) candidates.push_back(v);
+            } else if (best == -1 || fill < best_fill || (fill == best_fill && weight < best_weight)) {
+                best = v;
+                best_fill = fill;
+                best_weight = weight;
+            }
+        }
+        if (tie_break_rng) {
+            best = candidates[std::uniform_int_distribution<size_t>(0, candidates.size() - 1)(*tie_break_rng)];
+        }
+
+        // Collega tra loro i vicini della variabile eliminata, poi rimuovila dal grafo
+        for (int a : neighbours[best]) {
+            for (int b : neighbours[best]) {
+                if (a != b) {
+                    neighbours[a].insert(b);
+                    adjacent[a][b] = 1;
+                }
+            }
+            neighbours[a].erase(best);
+            adjacent[a][best] = 0;
+        }
+        neighbours[best].clear();
+        eliminated[best] = true;
+        order.push_back(best);
+    }
+    return order;
+}
+
 // Funzione per creare una nuova BayesianNetwork con ID riassegnati in ordine topologico
 // Prende la rete originale e l'ordinamento topologico (vecchi ID)
 BayesianNetwork reorder_network_topologically(const BayesianNetwork& original_bn, const std::vector<int>& topological_order) {
@@ -417,172 +953,306 @@ std::string getValueString(const Variable& var, int index) {
     return "";
 }
 
-// Funzione (DA IMPLEMENTARE) per ottenere la probabilità condizionale dalla CPT
-// target_var: la variabile di cui vogliamo la probabilità
-// config_vector_ancestors: la configurazione corrente delle variabili già elaborate topologicamente 
-// target_value_idx: l'indice del valore che target_var assume
-// bn: la rete bayesiana (necessaria per mappare i genitori, e quindi ottenere il loro id a partire dal nome)
-double getConditionalProbabilityFromCPT(
-    const Variable& target_var, 
-    const std::vector<int>& config_vector_ancestors,
-    int target_value_idx,
-    const BayesianNetwork& bn // Passa la BN per accedere ai dati dei genitori
-) {
-    // Caso 1: Nessun genitore (variabile radice)
-    if (target_var.parents.empty()) {
-        if (target_var.cpt.empty() || target_var.cpt[0].size() <= target_value_idx) {
-            std::cerr << "Error: CPT for " << target_var.name << " is empty or invalid for value index " << target_value_idx << std::endl;
-            return 0.0;
-        }
-        return target_var.cpt[0][target_value_idx]; // Probabilità marginale diretta
+std::string getCPTKindName(CPTKind kind) {
+    switch (kind) {
+        case CPTKind::Dense: return "dense";
+        case CPTKind::NoisyOR: return "noisy-or";
+        case CPTKind::NoisyMAX: return "noisy-max";
+        case CPTKind::Tree: return "tree";
+        case CPTKind::Sparse: return "sparse";
     }
+    return "unknown";
+}
 
-    // Caso 2: Ha genitori
-    // Dobbiamo costruire la configurazione dei genitori a partire da quella di tutti gli antenati indiretti fornita come parametro
-    std::vector<int> parent_value_indices; 
-    for (const std::string& parent_name : target_var.parents) {
-        int parent_topo_id = bn.name_to_id.at(parent_name); // Questo è l'ID del genitore nell'ordinamento topologico, è qui che usiamo l'informazione proveniente dalla rete intera
+// Probabilita' che una causa noisy-MAX lasci la variabile a un grado <= `degree`.
+// Il grado del valore j e' (card - 1 - j): l'ultimo valore e' lo stato "assente" (grado 0).
+double noisyCumulative(const double* dist, int card, int degree) {
+    double sum = 0.0;
+    for (int j = std::max(0, card - 1 - degree); j < card; ++j) {
+        sum += dist[j];
+    }
+    return sum;
+}
 
-        if (parent_topo_id >= config_vector_ancestors.size()) {
-             // Questo genitore non dovrebbe essere un antenato nella configurazione attuale
-             std::cerr << "Error: Parent " << parent_name << " (ID " << parent_topo_id << ") not found in ancestor config." << std::endl;
-             return 0.0; // O gestire l'errore in altro modo
+// Probabilita' di una CPT compatta (tutti i tipi tranne Dense) sugli array grezzi dei parametri,
+// cosi' la usano sia Variable sia le reti compilate o mappate dal registro. Non alloca memoria.
+// Restituisce -1 se i parametri sono incompleti o nessuna regola dell'albero e' soddisfatta.
+//
+// Layout di params / index per ciascun tipo:
+//   NoisyOR, NoisyMAX:  params = leak[card], poi per ogni genitore i e ogni suo valore s una distribuzione [card]
+//   Tree:               index = per ogni regola [n, pos_1, val_1, ..., pos_n, val_n]; params = distribuzione [card] per regola
+//   Sparse:             params = riga di default [card], poi un valore per chiave;
+//                       index = [n_righe, righe elencate (ordinate)..., chiavi riga*card+valore (ordinate)...]
+double compactProbability(CPTKind kind, int card, const double* params, size_t params_size,
+                          const long long* index, size_t index_size,
+                          const int* parent_values, const int* parent_cards, size_t parent_count, int value) {
+    switch (kind) {
+        case CPTKind::NoisyOR:
+        case CPTKind::NoisyMAX: {
+            // P(grado <= d | u) = C_leak(d) * prod_i C_{i,u_i}(d): le cause agiscono indipendentemente
+            size_t needed = card;
+            for (size_t i = 0; i < parent_count; ++i) needed += static_cast<size_t>(parent_cards[i]) * card;
+            if (needed > params_size) return -1.0;
+
+            int degree = card - 1 - value;
+            double cumulative = noisyCumulative(params, card, degree);
+            double cumulative_below = degree > 0 ? noisyCumulative(params, card, degree - 1) : 0.0;
+            size_t offset = card;
+            for (size_t i = 0; i < parent_count; ++i) {
+                const double* link = params + offset + static_cast<size_t>(parent_values[i]) * card;
+                cumulative *= noisyCumulative(link, card, degree);
+                if (degree > 0) cumulative_below *= noisyCumulative(link, card, degree - 1);
+                offset += static_cast<size_t>(parent_cards[i]) * card;
+            }
+            return cumulative - cumulative_below;
         }
-        
-        int parent_val_idx = config_vector_ancestors[parent_topo_id];
-        parent_value_indices.push_back(parent_val_idx);
-    }
 
-    // Calcola l'indice di riga della CPT (generalizzato al caso di variabili che assumono anche più di 2 valori)
-    int cpt_row_index = 0;
-    int multiplier = 1;
-    for (size_t i = 0; i < target_var.parents.size(); ++i) {
-        const Variable& parent_var = bn.variables.at(target_var.parents[target_var.parents.size() - 1 - i]); // Dal meno significativo al più significativo
-        cpt_row_index += parent_value_indices[target_var.parents.size() - 1 - i] * multiplier;
-        multiplier *= static_cast<int>(parent_var.values.size());
-    }
+        case CPTKind::Tree: {
+            // Prima regola il cui contesto e' soddisfatto dalla configurazione dei genitori
+            size_t pos = 0;
+            size_t rule = 0;
+            while (pos < index_size) {
+                long long context_size = index[pos++];
+                bool matches = true;
+                for (long long k = 0; k < context_size; ++k) {
+                    if (parent_values[index[pos + 2 * k]] != index[pos + 2 * k + 1]) {
+                        matches = false;
+                        break;
+                    }
+                }
+                if (matches) {
+                    return params[rule * card + value];
+                }
+                pos += 2 * context_size;
+                ++rule;
+            }
+            return -1.0;
+        }
 
-    if (cpt_row_index >= target_var.cpt.size() || target_var.cpt[cpt_row_index].size() <= target_value_idx) {
-        std::cerr << "Error: CPT lookup out of bounds for " << target_var.name << " at row " << cpt_row_index << " / val " << target_value_idx << std::endl;
-        return 0.0;
-    }
+        case CPTKind::Sparse: {
+            if (index_size == 0) return -1.0;
+            long long row = 0;
+            for (size_t i = 0; i < parent_count; ++i) {
+                row = row * parent_cards[i] + parent_values[i];
+            }
+            long long key = row * card + value;
+
+            const long long* rows_begin = index + 1;
+            const long long* rows_end = rows_begin + index[0];
+            const long long* keys_end = index + index_size;
+            const long long* key_it = std::lower_bound(rows_end, keys_end, key);
+            if (key_it != keys_end && *key_it == key) {
+                return params[card + (key_it - rows_end)];
+            }
+            if (std::binary_search(rows_begin, rows_end, row)) {
+                return 0.0; // riga elencata: le voci mancanti sono zeri impliciti
+            }
+            return params[value];
+        }
 
-    return target_var.cpt[cpt_row_index][target_value_idx];
+        case CPTKind::Dense:
+            break;
+    }
+    return -1.0;
 }
 
-
-// New function signature for calculating marginals with optional evidence and query variable
-std::map<std::string, std::map<std::string, double>> calculateProbabilitiesWithEvidence(
-    const BayesianNetwork& reordered_bn,
-    const Evidence& evidence // New parameter for evidence
+// Probabilita' P(target = target_value_idx | genitori) letta dalla rappresentazione della CPT,
+// senza mai espanderla in forma densa.
+// parent_value_indices / parent_cardinalities: valori e cardinalita' dei genitori, nell'ordine di var.parents
+// Dense usa var.cpt (riga = configurazione dei genitori, primo genitore piu' significativo),
+// gli altri tipi var.cpt_params / var.cpt_index con il layout di compactProbability.
+double getProbabilityFromParentValues(
+    const Variable& var,
+    const std::vector<int>& parent_value_indices,
+    const std::vector<int>& parent_cardinalities,
+    int target_value_idx
 ) {
-    std::map<std::vector<int>, double> current_joint_probabilities; // Key: config (vector of value indices), Value: joint probability P(config)
-    std::map<std::vector<int>, double> current_partial_probabilities;
-
+    const int card = static_cast<int>(var.values.size());
+    if (target_value_idx < 0 || target_value_idx >= card) {
+        std::cerr << "Error: value index " << target_value_idx << " out of range for " << var.name << std::endl;
+        return 0.0;
+    }
 
-    // Map variable names to their value indices for faster lookup
-    // e.g., for var "a", if "true" is at index 0, "false" at index 1: value_to_idx["a"]["true"] = 0
-    std::map<std::string, std::map<std::string, int>> var_value_to_idx;
-    for (const auto& pair : reordered_bn.variables) {
-        const Variable& var = pair.second;
-        for (size_t i = 0; i < var.values.size(); ++i) {
-            var_value_to_idx[var.name][var.values[i]] = static_cast<int>(i);
+    if (var.cpt_kind == CPTKind::Dense) {
+        // Calcola l'indice di riga della CPT (generalizzato al caso di variabili che assumono anche più di 2 valori)
+        long long cpt_row_index = 0;
+        for (size_t i = 0; i < parent_value_indices.size(); ++i) {
+            cpt_row_index = cpt_row_index * parent_cardinalities[i] + parent_value_indices[i];
         }
+        if (cpt_row_index >= static_cast<long long>(var.cpt.size()) || var.cpt[cpt_row_index].size() <= static_cast<size_t>(target_value_idx)) {
+            std::cerr << "Error: CPT lookup out of bounds for " << var.name << " at row " << cpt_row_index << " / val " << target_value_idx << std::endl;
+            return 0.0;
+        }
+        return var.cpt[cpt_row_index][target_value_idx];
     }
 
-    // Iterate through variables in topological order
-    for (int var_topo_id = 0; var_topo_id < reordered_bn.next_id; ++var_topo_id) {
-        const std::string& var_name = reordered_bn.id_to_name.at(var_topo_id);
-        const Variable& current_var = reordered_bn.variables.at(var_name);
+    double probability = compactProbability(var.cpt_kind, card, var.cpt_params.data(), var.cpt_params.size(),
+                                            var.cpt_index.data(), var.cpt_index.size(), parent_value_indices.data(),
+                                            parent_cardinalities.data(), parent_value_indices.size(), target_value_idx);
+    if (probability < 0.0) {
+        std::cerr << "Error: the " << getCPTKindName(var.cpt_kind) << " CPT of " << var.name
+                  << " has no entry for the parent configuration" << std::endl;
+        return 0.0;
+    }
+    return probability;
+}
 
-        std::map<std::vector<int>, double> next_joint_probabilities;
+// Distribuzione del massimo (in gradi) di due cause indipendenti: P(grado <= d) = C_a(d) * C_b(d)
+static std::vector<double> maxCombination(const double* a, const double* b, int card) {
+    std::vector<double> result(card);
+    for (int j = 0; j < card; ++j) {
+        int degree = card - 1 - j;
+        double below = degree > 0 ? noisyCumulative(a, card, degree - 1) * noisyCumulative(b, card, degree - 1) : 0.0;
+        result[j] = noisyCumulative(a, card, degree) * noisyCumulative(b, card, degree) - below;
+    }
+    return result;
+}
 
-        if (var_topo_id == 0) { // First variable (root)
-            for (size_t val_idx = 0; val_idx < current_var.values.size(); ++val_idx) {
-                std::vector<int> config = {static_cast<int>(val_idx)};
-                double prob = getConditionalProbabilityFromCPT(current_var, {}, static_cast<int>(val_idx), reordered_bn);
+static void replaceChild(BayesianNetwork& bn, int parent_id, int old_child, int new_child) {
+    std::vector<int>& children = bn.adj[parent_id];
+    children.erase(std::remove(children.begin(), children.end(), old_child), children.end());
+    if (new_child >= 0) children.push_back(new_child);
+}
 
-                // Apply evidence: if this config contradicts evidence, set prob to 0
-                if (evidence.count(var_name)) { // Is this variable part of the evidence?
-                    int evidence_val_idx = var_value_to_idx.at(var_name).at(evidence.at(var_name));
-                    if (val_idx != evidence_val_idx) {
-                        prob = 0.0; // This configuration is inconsistent with evidence
-                    }
-                }
-                next_joint_probabilities[config] = prob;
-                current_partial_probabilities[config] = prob;
-            }
-        } else { // Subsequent variables
-            for (const auto& entry : current_joint_probabilities) {
-                const std::vector<int>& prev_config = entry.first;
-                double prev_joint_prob = entry.second;
-
-                for (size_t val_idx = 0; val_idx < current_var.values.size(); ++val_idx) {
-                    std::vector<int> current_config = prev_config;
-                    current_config.push_back(static_cast<int>(val_idx));
-
-                    double conditional_prob = getConditionalProbabilityFromCPT(
-                        current_var,
-                        prev_config,
-                        static_cast<int>(val_idx),
-                        reordered_bn
-                    );
-
-                    double joint_prob_for_current_config = prev_joint_prob * conditional_prob;
-
-                    // Apply evidence for the current variable:
-                    if (evidence.count(var_name)) {
-                        int evidence_val_idx = var_value_to_idx.at(var_name).at(evidence.at(var_name));
-                        if (val_idx != evidence_val_idx) {
-                            joint_prob_for_current_config = 0.0; // Inconsistent with evidence
-                        }
-                    }
-                    next_joint_probabilities[current_config] = joint_prob_for_current_config;
-                    current_partial_probabilities[current_config] = joint_prob_for_current_config;
-                }
+// Scompone una famiglia noisy-OR/MAX Y(U_1..U_n) nella catena temporale
+//   A_1(U_1), A_2(A_1, U_2), ..., A_{n-1}(A_{n-2}, U_{n-1}), Y(A_{n-1}, U_n)
+// dove A_i e' il massimo (in gradi) del leak e delle prime i cause: ogni CPT ha al piu' 3 variabili
+static void decomposeNoisyFamily(BayesianNetwork& bn, const std::string& child_name) {
+    Variable child = bn.variables.at(child_name);
+    const int card = static_cast<int>(child.values.size());
+    const size_t n = child.parents.size();
+
+    std::vector<const double*> links;  // distribuzione del parent i al suo valore 0
+    std::vector<int> parent_cards;
+    size_t offset = card;
+    for (const std::string& parent_name : child.parents) {
+        links.push_back(child.cpt_params.data() + offset);
+        parent_cards.push_back(static_cast<int>(bn.variables.at(parent_name).values.size()));
+        offset += static_cast<size_t>(parent_cards.back()) * card;
+    }
+    const double* leak = child.cpt_params.data();
+
+    std::string previous;
+    for (size_t i = 0; i < n; ++i) {
+        const bool last = i + 1 == n;
+        Variable link;
+        if (last) {
+            link = child;
+            link.cpt_kind = CPTKind::Dense;
+            link.cpt_params.clear();
+            link.cpt_index.clear();
+        } else {
+            std::string aux_name = child.name + "#" + std::to_string(i + 1);
+            while (bn.variables.count(aux_name)) aux_name += "#";
+            link.name = aux_name;
+            link.values = child.values;
+            link.id = bn.next_id++;
+            bn.name_to_id[link.name] = link.id;
+            bn.id_to_name[link.id] = link.name;
+            bn.adj.resize(bn.next_id);
+        }
+        link.parents.clear();
+        link.cpt.clear();
+        if (!previous.empty()) link.parents.push_back(previous);
+        link.parents.push_back(child.parents[i]);
+
+        // Righe nell'ordine (A_{i-1}, U_i); il primo anello assorbe il leak
+        const int previous_card = previous.empty() ? 1 : card;
+        for (int a = 0; a < previous_card; ++a) {
+            std::vector<double> state(card, 0.0);
+            if (previous.empty()) {
+                state.assign(leak, leak + card);
+            } else {
+                state[a] = 1.0;
+            }
+            for (int u = 0; u < parent_cards[i]; ++u) {
+                link.cpt.push_back(maxCombination(state.data(), links[i] + static_cast<size_t>(u) * card, card));
             }
         }
-        current_joint_probabilities = next_joint_probabilities;
+
+        int parent_id = bn.name_to_id.at(child.parents[i]);
+        replaceChild(bn, parent_id, child.id, link.id);
+        if (!previous.empty()) bn.adj[bn.name_to_id.at(previous)].push_back(link.id);
+        previous = link.name;
+        bn.variables[link.name] = link;
     }
+}
 
-    // --- Aggregation and Normalization ---
-    std::map<std::string, std::map<std::string, double>> marginal_probabilities;
+// Toglie i genitori di una CPT ad albero che nessuna regola controlla: non contano in nessun contesto
+static void pruneTreeParents(BayesianNetwork& bn, const std::string& name) {
+    Variable& var = bn.variables.at(name);
+    std::vector<bool> tested(var.parents.size(), false);
+    for (size_t pos = 0; pos < var.cpt_index.size();) {
+        long long context_size = var.cpt_index[pos++];
+        for (long long k = 0; k < context_size; ++k) tested[var.cpt_index[pos + 2 * k]] = true;
+        pos += 2 * context_size;
+    }
 
-    // Initialize marginals
-    for (const auto& pair : reordered_bn.variables) {
-        const Variable& var = pair.second;
-        for (const std::string& val_str : var.values) {
-            marginal_probabilities[var.name][val_str] = 0.0;
+    std::vector<long long> new_position(var.parents.size(), -1);
+    std::vector<std::string> parents;
+    for (size_t i = 0; i < var.parents.size(); ++i) {
+        if (tested[i]) {
+            new_position[i] = static_cast<long long>(parents.size());
+            parents.push_back(var.parents[i]);
+        } else {
+            replaceChild(bn, bn.name_to_id.at(var.parents[i]), var.id, -1);
         }
     }
+    if (parents.size() == var.parents.size()) return;
 
-    // Calculate P(Evidence) for normalization (if evidence is present)
-    // prob_evidence è 1 se l'evidenza è vuota, altrimenti è la probabilità dell'evidenza 
-    double prob_evidence_sum = 0.0;
-    for (const auto& entry : current_joint_probabilities) {
-        prob_evidence_sum += entry.second;
+    for (size_t pos = 0; pos < var.cpt_index.size();) {
+        long long context_size = var.cpt_index[pos++];
+        for (long long k = 0; k < context_size; ++k) {
+            var.cpt_index[pos + 2 * k] = new_position[var.cpt_index[pos + 2 * k]];
+        }
+        pos += 2 * context_size;
     }
-    
-
-    // Aggregate marginal probabilities for each variable
-    for (const auto& entry : current_partial_probabilities) {
-        const std::vector<int>& final_config = entry.first;
-        double joint_prob_with_evidence = entry.second; // This is P(config, evidence)
+    var.parents = parents;
+}
 
-        // If evidence was provided, normalize by P(evidence)
-        if (!evidence.empty() && prob_evidence_sum > 1e-12) { // Avoid division by zero
-            joint_prob_with_evidence /= prob_evidence_sum; // Now it's P(config | evidence)
+BayesianNetwork decomposeCompactCPTs(const BayesianNetwork& bn) {
+    BayesianNetwork result = bn;
+    for (const auto& pair : bn.variables) {
+        const Variable& var = pair.second;
+        if ((var.cpt_kind == CPTKind::NoisyOR || var.cpt_kind == CPTKind::NoisyMAX) && var.parents.size() >= 3) {
+            decomposeNoisyFamily(result, var.name);
+        } else if (var.cpt_kind == CPTKind::Tree) {
+            pruneTreeParents(result, var.name);
         }
-
-        int i = final_config.size()-1;
-        const std::string &var_name = reordered_bn.id_to_name.at(i);
-        const Variable &var = reordered_bn.variables.at(var_name); // Get variable definition
-        int val_idx = final_config[i];
-        std::string val_str = getValueString(var, val_idx);
-
-        marginal_probabilities[var_name][val_str] += joint_prob_with_evidence;
     }
+    return result;
+}
 
-    return marginal_probabilities;
+// Funzione per ottenere la probabilità condizionale dalla CPT (denso o compatto)
+// target_var: la variabile di cui vogliamo la probabilità
+// config_vector_ancestors: la configurazione corrente delle variabili, indicizzata per ID
+// target_value_idx: l'indice del valore che target_var assume
+// bn: la rete bayesiana (serve per ottenere l'ID dei genitori a partire dal nome)
+double getConditionalProbabilityFromCPT(
+    const Variable& target_var,
+    const std::vector<int>& config_vector_ancestors,
+    int target_value_idx,
+    const BayesianNetwork& bn
+) {
+    std::vector<int> parent_value_indices;
+    std::vector<int> parent_cardinalities;
+    for (const std::string& parent_name : target_var.parents) {
+        int parent_topo_id = bn.name_to_id.at(parent_name);
+        if (parent_topo_id >= static_cast<int>(config_vector_ancestors.size())) {
+            std::cerr << "Error: Parent " << parent_name << " (ID " << parent_topo_id << ") not found in ancestor config." << std::endl;
+            return 0.0;
+        }
+        parent_value_indices.push_back(config_vector_ancestors[parent_topo_id]);
+        parent_cardinalities.push_back(static_cast<int>(bn.variables.at(parent_name).values.size()));
+    }
+    return getProbabilityFromParentValues(target_var, parent_value_indices, parent_cardinalities, target_value_idx);
 }
 
+// Calcola le marginali P(X | evidenza) per ogni variabile: compila la rete e usa la versione
+// su CompiledNetwork (CompiledNetwork.h); chi interroga piu' volte compila una volta sola
+std::map<std::string, std::map<std::string, double>> calculateProbabilitiesWithEvidence(
+    const BayesianNetwork& reordered_bn,
+    const Evidence& evidence // New parameter for evidence
+) {
+    return calculateProbabilitiesWithEvidence(compileNetwork(reordered_bn), evidence);
+}
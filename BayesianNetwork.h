@@ -5,15 +5,32 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
+#include <random>
 #include <sstream> // Necessario per parseEvidenceString e forse trim
 
+// Representation used for a variable's conditional probability table
+enum class CPTKind {
+    Dense,    // one row per parent configuration, stored in Variable::cpt
+    NoisyOR,  // noisy-OR with leak (binary child, special case of NoisyMAX)
+    NoisyMAX, // noisy-MAX with leak over ordered child values
+    Tree,     // context-specific rules (root-to-leaf paths of a decision tree)
+    Sparse    // only non-zero entries stored, everything else is implicitly zero
+};
+
 // Define a structure for a variable
 struct Variable {
     std::string name;
     std::vector<std::string> values;
     std::vector<std::string> parents;
-    std::vector<std::vector<double>> cpt;
+    std::vector<std::vector<double>> cpt; // used only when cpt_kind == CPTKind::Dense
     int id;
+
+    // Compact CPT parameters (layout depends on cpt_kind, see getProbabilityFromParentValues).
+    // The last value of the child and of every parent is the "absent" state for noisy-OR/MAX.
+    CPTKind cpt_kind = CPTKind::Dense;
+    std::vector<double> cpt_params;
+    std::vector<long long> cpt_index;
 };
 
 // A simple structure to hold the entire Bayesian Network
@@ -31,15 +48,36 @@ using Evidence = std::map<std::string, std::string>;
 // --- Funzioni Utility (spostate qui da Utils.h) ---
 std::string trim(const std::string& str);
 Evidence parseEvidenceString(const std::string& evidence_str);
+std::vector<int> evidenceToValues(const BayesianNetwork& bn, const Evidence& evidence);
+long long parseMemorySize(const std::string& size_str);
 // --- Fine Funzioni Utility ---
 
 // Function declarations for Bayesian Network logic
 BayesianNetwork parseBIF(const std::string& filename);
+bool writeBIF(const BayesianNetwork& bn, const std::string& filename, const std::string& network_name = "unknown");
 std::vector<int> topological_sort(const BayesianNetwork& bn);
+std::vector<std::set<int>> moral_graph(const BayesianNetwork& bn);
+// Greedy min-fill order; ties go to the smallest family table, or to a random candidate drawn from tie_break_rng
+std::vector<int> min_fill_elimination_order(const BayesianNetwork& bn, std::mt19937_64* tie_break_rng = nullptr);
 BayesianNetwork reorder_network_topologically(const BayesianNetwork& original_bn, const std::vector<int>& topological_order);
+double getProbabilityFromParentValues(const Variable& var, const std::vector<int>& parent_value_indices, const std::vector<int>& parent_cardinalities, int target_value_idx);
+double noisyCumulative(const double* dist, int card, int degree);
+// Entry of a compact CPT (any kind but Dense) from raw arrays laid out as Variable::cpt_params / cpt_index.
+// Allocation-free; returns -1 if the parameters are incomplete or no tree rule matches.
+double compactProbability(CPTKind kind, int card, const double* params, size_t params_size,
+                          const long long* index, size_t index_size,
+                          const int* parent_values, const int* parent_cards, size_t parent_count, int value);
+// Equivalent network for the engines that work on the graph (recursive conditioning, mini-buckets):
+// noisy-OR/MAX families with 3 or more parents become a chain of auxiliary variables "<child>#k"
+// with CPTs over at most 3 variables, and tree CPTs lose the parents that no rule tests.
+// The original variables keep their IDs, the auxiliary ones are appended.
+BayesianNetwork decomposeCompactCPTs(const BayesianNetwork& bn);
+// P(target = target_value_idx | parents), with the parent values read by ID from config_vector_ancestors
 double getConditionalProbabilityFromCPT(const Variable& target_var, const std::vector<int>& config_vector_ancestors, int target_value_idx, const BayesianNetwork& bn);
 std::map<std::string, std::map<std::string, double>> calculateProbabilitiesWithEvidence(const BayesianNetwork& reordered_bn, const Evidence& evidence);
 std::string getValueString(const Variable& var, int index);
+int findValueIndex(const Variable& var, const std::string& value);
+std::string getCPTKindName(CPTKind kind);
 
 #endif // BAYESIAN_NETWORK_H
 
@@ -0,0 +1,229 @@
+// CompiledNetwork.cpp
+#include "CompiledNetwork.h"
+#include <iostream>
+#include <algorithm>
+
+CompiledNetwork compileNetwork(const BayesianNetwork& bn) {
+    CompiledNetwork net;
+    const int n = bn.next_id;
+    net.names.resize(n);
+    net.values.resize(n);
+    net.cardinality.resize(n);
+    std::vector<const Variable*> variables(n, nullptr);
+    for (const auto& pair : bn.variables) {
+        const Variable& var = pair.second;
+        variables[var.id] = &var;
+        net.names[var.id] = var.name;
+        net.values[var.id] = var.values;
+        net.cardinality[var.id] = static_cast<int>(var.values.size());
+        net.name_to_handle[var.name] = var.id;
+    }
+
+    net.posterior_offset.assign(n + 1, 0);
+    for (int x = 0; x < n; ++x) {
+        net.posterior_offset[x + 1] = net.posterior_offset[x] + net.cardinality[x];
+    }
+    net.topological_order = topological_sort(bn);
+
+    net.parent_begin.assign(n + 1, 0);
+    net.cpt_kind.assign(n, static_cast<int>(CPTKind::Dense));
+    net.cpt_offset.assign(n + 1, 0);
+    net.index_offset.assign(n + 1, 0);
+    for (int x = 0; x < n; ++x) {
+        const Variable& var = *variables[x];
+        std::vector<int> parent_values;
+        std::vector<int> parent_cards;
+        for (const std::string& parent_name : var.parents) {
+            int parent_id = bn.name_to_id.at(parent_name);
+            net.parent_ids.push_back(parent_id);
+            parent_values.push_back(0);
+            parent_cards.push_back(net.cardinality[parent_id]);
+        }
+        net.parent_begin[x + 1] = static_cast<int>(net.parent_ids.size());
+
+        long long stride = 1;
+        std::vector<long long> strides(parent_cards.size());
+        for (size_t k = parent_cards.size(); k-- > 0;) {
+            strides[k] = stride;
+            stride *= parent_cards[k];
+        }
+        net.parent_strides.insert(net.parent_strides.end(), strides.begin(), strides.end());
+
+        // Solo le CPT dense diventano righe piatte; le compatte restano compatte
+        net.cpt_kind[x] = static_cast<int>(var.cpt_kind);
+        net.cpt_offset[x] = static_cast<long long>(net.cpt.size());
+        net.index_offset[x] = static_cast<long long>(net.cpt_index.size());
+        if (var.cpt_kind == CPTKind::Dense) {
+            const long long rows = stride;
+            for (long long row = 0; row < rows; ++row) {
+                for (int v = 0; v < net.cardinality[x]; ++v) {
+                    net.cpt.push_back(getProbabilityFromParentValues(var, parent_values, parent_cards, v));
+                }
+                for (size_t k = parent_values.size(); k-- > 0;) {
+                    if (++parent_values[k] < parent_cards[k]) break;
+                    parent_values[k] = 0;
+                }
+            }
+        } else {
+            net.cpt.insert(net.cpt.end(), var.cpt_params.begin(), var.cpt_params.end());
+            net.cpt_index.insert(net.cpt_index.end(), var.cpt_index.begin(), var.cpt_index.end());
+        }
+    }
+    net.cpt_offset[n] = static_cast<long long>(net.cpt.size());
+    net.index_offset[n] = static_cast<long long>(net.cpt_index.size());
+    return net;
+}
+
+NetworkView viewNetwork(const CompiledNetwork& net) {
+    NetworkView view;
+    view.size = net.size();
+    view.cardinality = net.cardinality.data();
+    view.posterior_offset = net.posterior_offset.data();
+    view.topological_order = net.topological_order.data();
+    view.parent_begin = net.parent_begin.data();
+    view.parent_ids = net.parent_ids.data();
+    view.parent_strides = net.parent_strides.data();
+    view.cpt_kind = net.cpt_kind.data();
+    view.cpt_offset = net.cpt_offset.data();
+    view.cpt = net.cpt.data();
+    view.index_offset = net.index_offset.data();
+    view.cpt_index = net.cpt_index.data();
+    return view;
+}
+
+int variableHandle(const CompiledNetwork& net, const std::string& name) {
+    auto it = net.name_to_handle.find(name);
+    return it == net.name_to_handle.end() ? -1 : it->second;
+}
+
+int valueHandle(const CompiledNetwork& net, int variable, const std::string& value) {
+    if (variable < 0 || variable >= net.size()) return -1;
+    const std::vector<std::string>& values = net.values[variable];
+    auto it = std::find(values.begin(), values.end(), value);
+    return it == values.end() ? -1 : static_cast<int>(it - values.begin());
+}
+
+EnumerationEngine::EnumerationEngine(const NetworkView& net)
+    : net_(net), observed_(net.size, -1), assignment_(net.size, 0), probs_(net.size > 0 ? net.posteriorSize() : 0) {
+    int max_parents = 0;
+    for (int x = 0; x < net.size; ++x) {
+        max_parents = std::max(max_parents, net.parent_begin[x + 1] - net.parent_begin[x]);
+    }
+    parent_values_.resize(max_parents);
+    parent_cards_.resize(max_parents);
+}
+
+EnumerationEngine::EnumerationEngine(const CompiledNetwork& net) : EnumerationEngine(viewNetwork(net)) {}
+
+double EnumerationEngine::query(const EvidenceHandle* evidence, size_t evidence_count, double* posteriors) {
+    std::fill(observed_.begin(), observed_.end(), -1);
+    std::fill(posteriors, posteriors + net_.posteriorSize(), 0.0);
+
+    bool consistent = true;
+    for (size_t i = 0; i < evidence_count; ++i) {
+        int x = evidence[i].variable;
+        int v = evidence[i].value;
+        if (x < 0 || x >= net_.size || v < 0 || v >= net_.cardinality[x]) {
+            std::cerr << "Error: invalid evidence handle (" << x << ", " << v << ")" << std::endl;
+            return -1.0;
+        }
+        if (observed_[x] >= 0 && observed_[x] != v) consistent = false; // due valori diversi per la stessa variabile
+        observed_[x] = v;
+    }
+
+    posteriors_ = posteriors;
+    total_ = 0.0;
+    if (consistent) enumerate(0, 1.0);
+
+    if (total_ > 0.0) {
+        for (int k = 0; k < net_.posteriorSize(); ++k) posteriors[k] /= total_;
+    }
+    return total_;
+}
+
+// Visita in profondita' delle configurazioni in ordine topologico: i rami incompatibili con
+// l'evidenza o con probabilita' nulla vengono potati, ogni foglia contribuisce P(config, e)
+void EnumerationEngine::enumerate(int depth, double weight) {
+    if (depth == net_.size) {
+        total_ += weight;
+        for (int x = 0; x < net_.size; ++x) {
+            posteriors_[net_.posterior_offset[x] + assignment_[x]] += weight;
+        }
+        return;
+    }
+
+    const int x = net_.topological_order[depth];
+    int first = 0;
+    int last = net_.cardinality[x];
+    if (observed_[x] >= 0) {
+        first = observed_[x];
+        last = first + 1;
+    }
+
+    const double* probs;
+    const CPTKind kind = static_cast<CPTKind>(net_.cpt_kind[x]);
+    if (kind == CPTKind::Dense) {
+        long long row = 0;
+        for (int k = net_.parent_begin[x]; k < net_.parent_begin[x + 1]; ++k) {
+            row += assignment_[net_.parent_ids[k]] * net_.parent_strides[k];
+        }
+        probs = net_.cpt + net_.cpt_offset[x] + row * net_.cardinality[x];
+    } else {
+        // Le voci servono prima di scendere: la ricorsione riusa i buffer dei genitori
+        const int parent_count = net_.parent_begin[x + 1] - net_.parent_begin[x];
+        for (int k = 0; k < parent_count; ++k) {
+            int parent = net_.parent_ids[net_.parent_begin[x] + k];
+            parent_values_[k] = assignment_[parent];
+            parent_cards_[k] = net_.cardinality[parent];
+        }
+        double* row = probs_.data() + net_.posterior_offset[x];
+        for (int v = first; v < last; ++v) {
+            row[v] = compactProbability(kind, net_.cardinality[x], net_.cpt + net_.cpt_offset[x],
+                                        static_cast<size_t>(net_.cpt_offset[x + 1] - net_.cpt_offset[x]),
+                                        net_.cpt_index + net_.index_offset[x],
+                                        static_cast<size_t>(net_.index_offset[x + 1] - net_.index_offset[x]),
+                                        parent_values_.data(), parent_cards_.data(), parent_count, v);
+        }
+        probs = row;
+    }
+
+    for (int v = first; v < last; ++v) {
+        if (probs[v] <= 0.0) continue; // zero (o voce mancante): ramo potato
+        assignment_[x] = v;
+        enumerate(depth + 1, weight * probs[v]);
+    }
+}
+
+// Calcola le marginali P(X | evidenza) per ogni variabile: wrapper con nomi stringa sopra
+// EnumerationEngine, che risolve i nomi una sola volta e lavora solo con indici interi
+std::map<std::string, std::map<std::string, double>> calculateProbabilitiesWithEvidence(
+    const CompiledNetwork& net,
+    const Evidence& evidence
+) {
+    std::vector<EvidenceHandle> evidence_handles;
+    for (const auto& e_pair : evidence) {
+        int variable = variableHandle(net, e_pair.first);
+        if (variable < 0) {
+            std::cerr << "Error: evidence on unknown variable " << e_pair.first << std::endl;
+            continue;
+        }
+        int value = valueHandle(net, variable, e_pair.second);
+        if (value < 0) {
+            std::cerr << "Error: unknown value " << e_pair.second << " for variable " << e_pair.first << std::endl;
+            continue;
+        }
+        evidence_handles.push_back({variable, value});
+    }
+
+    EnumerationEngine engine(net);
+    std::vector<double> posteriors(net.posteriorSize());
+    engine.query(evidence_handles.data(), evidence_handles.size(), posteriors.data());
+
+    std::map<std::string, std::map<std::string, double>> marginal_probabilities;
+    for (int x = 0; x < net.size(); ++x) {
+        for (int v = 0; v < net.cardinality[x]; ++v) {
+            marginal_probabilities[net.names[x]][net.values[x][v]] = posteriors[net.posterior_offset[x] + v];
+        }
+    }
+    return marginal_probabilities;
+}
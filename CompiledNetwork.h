@@ -0,0 +1,97 @@
+#ifndef COMPILED_NETWORK_H
+#define COMPILED_NETWORK_H
+
+#include "BayesianNetwork.h"
+#include <unordered_map>
+
+// Network with every name resolved to an integer handle once: a variable is its ID in the
+// source BayesianNetwork, a value is its index in Variable::values. The parameters of all the CPTs
+// share one array, cpt[cpt_offset[X] .. cpt_offset[X + 1]), and keep their representation:
+//   Dense:  cpt[cpt_offset[X] + row * cardinality[X] + value], where the row is
+//           sum_k value(parent_k) * parent_strides[k] (first parent most significant, as in Variable::cpt)
+//   others: Variable::cpt_params, with Variable::cpt_index in cpt_index[index_offset[X] .. index_offset[X + 1]),
+//           evaluated entry by entry by compactProbability (never expanded)
+struct CompiledNetwork {
+    std::vector<std::string> names;
+    std::vector<std::vector<std::string>> values;
+    std::vector<int> cardinality;
+    std::vector<int> posterior_offset;      // size n + 1: P(X = v | e) lives at posterior_offset[X] + v
+    std::vector<int> topological_order;
+    std::vector<int> parent_begin;          // parents of X: parent_ids[parent_begin[X] .. parent_begin[X + 1])
+    std::vector<int> parent_ids;
+    std::vector<long long> parent_strides;
+    std::vector<int> cpt_kind;              // CPTKind of each variable
+    std::vector<long long> cpt_offset;      // size n + 1
+    std::vector<double> cpt;
+    std::vector<long long> index_offset;    // size n + 1
+    std::vector<long long> cpt_index;
+    std::unordered_map<std::string, int> name_to_handle;
+
+    int size() const { return static_cast<int>(cardinality.size()); }
+    int posteriorSize() const { return posterior_offset.back(); }
+};
+
+// Non-owning, read-only view of the arrays of a compiled network. It points either into a
+// CompiledNetwork or into a model mapped from the registry (ModelRegistry.h), so the engines
+// below run on both without copying.
+struct NetworkView {
+    int size = 0;
+    const int* cardinality = nullptr;
+    const int* posterior_offset = nullptr;
+    const int* topological_order = nullptr;
+    const int* parent_begin = nullptr;
+    const int* parent_ids = nullptr;
+    const long long* parent_strides = nullptr;
+    const int* cpt_kind = nullptr;
+    const long long* cpt_offset = nullptr;
+    const double* cpt = nullptr;
+    const long long* index_offset = nullptr;
+    const long long* cpt_index = nullptr;
+
+    int posteriorSize() const { return posterior_offset[size]; }
+};
+
+// Evidence as (variable handle, value index)
+struct EvidenceHandle {
+    int variable;
+    int value;
+};
+
+CompiledNetwork compileNetwork(const BayesianNetwork& bn);
+NetworkView viewNetwork(const CompiledNetwork& net);
+
+// Name resolution, meant to be done once outside the hot path. Both return -1 if unknown.
+int variableHandle(const CompiledNetwork& net, const std::string& name);
+int valueHandle(const CompiledNetwork& net, int variable, const std::string& value);
+
+// Exact inference by enumeration of the joint distribution in topological order.
+// All the buffers are sized in the constructor, so queries do not allocate.
+// Not thread-safe: use one engine per thread (the network can be shared, and must outlive the engine).
+class EnumerationEngine {
+public:
+    explicit EnumerationEngine(const NetworkView& net);
+    explicit EnumerationEngine(const CompiledNetwork& net);
+
+    // Writes P(X = v | e) at posteriors[posterior_offset[X] + v] for every variable (the buffer must
+    // hold posteriorSize() doubles) and returns P(e). Impossible evidence gives 0 and all-zero
+    // posteriors; an invalid handle gives -1.
+    double query(const EvidenceHandle* evidence, size_t evidence_count, double* posteriors);
+
+private:
+    NetworkView net_;
+    std::vector<int> observed_;
+    std::vector<int> assignment_;
+    std::vector<double> probs_;             // CPT row of each variable on the current branch (compact kinds)
+    std::vector<int> parent_values_;        // scratch for compactProbability
+    std::vector<int> parent_cards_;
+    double* posteriors_ = nullptr;
+    double total_ = 0.0;
+
+    void enumerate(int depth, double weight);
+};
+
+// Marginals P(X | e) by variable and value name, for callers that work with strings.
+// Compile the network once and reuse it: the BayesianNetwork overload compiles on every call.
+std::map<std::string, std::map<std::string, double>> calculateProbabilitiesWithEvidence(const CompiledNetwork& net, const Evidence& evidence);
+
+#endif // COMPILED_NETWORK_H
@@ -0,0 +1,334 @@
+// Learning.cpp
+#include "Learning.h"
+#include "BatchScoring.h"
+#include "RecursiveConditioning.h"
+#include "ModelRegistry.h"
+#include <iostream>
+#include <algorithm>
+#include <fstream>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+namespace {
+
+// Layout delle statistiche sufficienti: per ogni variabile una tabella piatta indicizzata da
+// (riga della configurazione dei genitori) * card + valore, con le righe ordinate come in Variable::cpt
+struct FamilyLayout {
+    std::vector<int> cardinality;                       // by ID
+    std::vector<std::vector<int>> parent_ids;           // by ID, in the order of Variable::parents
+    std::vector<std::vector<long long>> parent_strides; // row stride of each parent (first parent most significant)
+    std::vector<long long> rows;                        // number of parent configurations
+};
+
+using SufficientStatistics = std::vector<std::vector<double>>;
+
+FamilyLayout buildFamilyLayout(const BayesianNetwork& bn) {
+    FamilyLayout layout;
+    layout.cardinality.resize(bn.next_id);
+    layout.parent_ids.resize(bn.next_id);
+    layout.parent_strides.resize(bn.next_id);
+    layout.rows.resize(bn.next_id);
+    for (const auto& pair : bn.variables) {
+        layout.cardinality[pair.second.id] = static_cast<int>(pair.second.values.size());
+    }
+    for (const auto& pair : bn.variables) {
+        const Variable& var = pair.second;
+        long long stride = 1;
+        std::vector<int>& parents = layout.parent_ids[var.id];
+        for (const std::string& parent_name : var.parents) {
+            parents.push_back(bn.name_to_id.at(parent_name));
+        }
+        layout.parent_strides[var.id].resize(parents.size());
+        for (size_t i = parents.size(); i-- > 0;) {
+            layout.parent_strides[var.id][i] = stride;
+            stride *= layout.cardinality[parents[i]];
+        }
+        layout.rows[var.id] = stride;
+    }
+    return layout;
+}
+
+SufficientStatistics emptyStatistics(const FamilyLayout& layout) {
+    SufficientStatistics counts(layout.cardinality.size());
+    for (size_t v = 0; v < counts.size(); ++v) {
+        counts[v].assign(static_cast<size_t>(layout.rows[v] * layout.cardinality[v]), 0.0);
+    }
+    return counts;
+}
+
+void addStatistics(SufficientStatistics& total, const SufficientStatistics& partial) {
+    for (size_t v = 0; v < total.size(); ++v) {
+        for (size_t i = 0; i < total[v].size(); ++i) {
+            total[v][i] += partial[v][i];
+        }
+    }
+}
+
+// Indice della voce (riga dei genitori, valore) per la variabile v; tutta la famiglia deve essere istanziata
+long long familyIndex(const FamilyLayout& layout, int v, const std::vector<int>& values) {
+    long long row = 0;
+    for (size_t i = 0; i < layout.parent_ids[v].size(); ++i) {
+        row += values[layout.parent_ids[v][i]] * layout.parent_strides[v][i];
+    }
+    return row * layout.cardinality[v] + values[v];
+}
+
+bool familyObserved(const FamilyLayout& layout, int v, const std::vector<int>& observed) {
+    if (observed[v] < 0) return false;
+    for (int parent_id : layout.parent_ids[v]) {
+        if (observed[parent_id] < 0) return false;
+    }
+    return true;
+}
+
+// M-step (and complete-data estimate): theta = (N + alpha) / sum over the row of (N + alpha)
+void setCPTsFromStatistics(BayesianNetwork& bn, const FamilyLayout& layout, const SufficientStatistics& counts, double alpha) {
+    for (int v = 0; v < bn.next_id; ++v) {
+        Variable& var = bn.variables[bn.id_to_name.at(v)];
+        const int card = layout.cardinality[v];
+        var.cpt_kind = CPTKind::Dense;
+        var.cpt_params.clear();
+        var.cpt_index.clear();
+        var.cpt.assign(static_cast<size_t>(layout.rows[v]), std::vector<double>(card, 0.0));
+        for (long long row = 0; row < layout.rows[v]; ++row) {
+            double total = 0.0;
+            for (int x = 0; x < card; ++x) total += counts[v][row * card + x] + alpha;
+            for (int x = 0; x < card; ++x) {
+                var.cpt[row][x] = total > 0.0 ? (counts[v][row * card + x] + alpha) / total : 1.0 / card;
+            }
+        }
+    }
+}
+
+// Porzione [begin, end) del file assegnata a un worker. Ogni riga appartiene alla porzione
+// in cui inizia, cosi' i thread leggono il file (mappato in memoria) in parallelo senza un lettore centrale.
+struct FileSlice {
+    long long begin = 0;
+    long long end = 0;
+};
+
+std::vector<FileSlice> sliceDataFile(long long data_start, long long file_size, int parts) {
+    std::vector<FileSlice> slices(parts);
+    long long length = file_size - data_start;
+    for (int p = 0; p < parts; ++p) {
+        slices[p].begin = data_start + length * p / parts;
+        slices[p].end = data_start + length * (p + 1) / parts;
+    }
+    return slices;
+}
+
+// Il file e' mappato una volta sola (mapReadOnly) e condiviso in lettura da tutti i worker
+struct DataFile {
+    const char* data = nullptr;
+    long long size = 0;
+};
+
+template <typename RowFunction>
+void forEachRowInSlice(const DataFile& file, const FileSlice& slice, long long data_start, RowFunction process_row) {
+    const char* data = file.data;
+    const long long end = std::min(slice.end, file.size);
+    if (slice.begin >= end) return;
+    long long position = slice.begin;
+    if (slice.begin > data_start && data[slice.begin - 1] != '\n') {
+        // La riga a cavallo del confine appartiene alla porzione precedente
+        const void* newline = std::memchr(data + slice.begin, '\n', static_cast<size_t>(file.size - slice.begin));
+        position = newline ? static_cast<const char*>(newline) - data + 1 : file.size;
+    }
+    std::string line;
+    while (position < end) {
+        const void* newline = std::memchr(data + position, '\n', static_cast<size_t>(file.size - position));
+        long long line_end = newline ? static_cast<const char*>(newline) - data : file.size;
+        line.assign(data + position, static_cast<size_t>(line_end - position));
+        position = line_end + 1;
+        if (trim(line).empty()) continue;
+        process_row(line);
+    }
+}
+
+struct CountingResult {
+    SufficientStatistics counts;
+    long long rows = 0;
+    long long incomplete_rows = 0;
+    long long invalid_rows = 0;
+};
+
+// First pass: counts every family fully observed in a row
+void countObservedFamilies(const BayesianNetwork& bn, const FamilyLayout& layout, const CaseColumns& columns,
+                           const DataFile& data_file, FileSlice slice, long long data_start, CountingResult& result) {
+    result.counts = emptyStatistics(layout);
+    std::vector<int> observed(bn.next_id, -1);
+    forEachRowInSlice(data_file, slice, data_start, [&](const std::string& line) {
+        ++result.rows;
+        if (!parseCaseRow(columns, line, observed)) {
+            ++result.invalid_rows;
+            return;
+        }
+        bool complete = true;
+        for (int v = 0; v < bn.next_id; ++v) {
+            if (familyObserved(layout, v, observed)) {
+                result.counts[v][familyIndex(layout, v, observed)] += 1.0;
+            }
+            if (observed[v] < 0) complete = false;
+        }
+        if (!complete) ++result.incomplete_rows;
+    });
+}
+
+struct ExpectationResult {
+    SufficientStatistics counts;
+    double log_likelihood = 0.0;
+    long long invalid_rows = 0;
+};
+
+// E-step: for every family with missing members adds P(family configuration | row) to the counts.
+// All the family posteriors of a row come from one differentiation pass of the recursive conditioning
+// engine used by batch scoring (one per thread, cache_budget is this thread's share).
+void expectedFamilyCounts(const BayesianNetwork& bn, const FamilyLayout& layout, const CaseColumns& columns,
+                          const DataFile& data_file, FileSlice slice, long long data_start, long long cache_budget,
+                          ExpectationResult& result) {
+    result.counts = emptyStatistics(layout);
+    RecursiveConditioningEngine engine(bn, cache_budget);
+    std::vector<const Variable*> variables(bn.next_id);
+    for (const auto& pair : bn.variables) variables[pair.second.id] = &pair.second;
+
+    std::vector<int> observed(bn.next_id, -1);
+    std::vector<int> missing_families;
+    std::vector<std::vector<double>> family_marginals(bn.next_id);
+    forEachRowInSlice(data_file, slice, data_start, [&](const std::string& line) {
+        if (!parseCaseRow(columns, line, observed)) return;
+
+        bool complete = std::find(observed.begin(), observed.end(), -1) == observed.end();
+        if (complete) {
+            // Le famiglie sono gia' nei conteggi osservati: serve solo la log-verosimiglianza.
+            // Con alpha 0 una voce della CPT puo' essere zero: la riga e' impossibile come sotto
+            double log_likelihood = 0.0;
+            for (int v = 0; v < bn.next_id; ++v) {
+                long long index = familyIndex(layout, v, observed);
+                double probability = variables[v]->cpt[index / layout.cardinality[v]][index % layout.cardinality[v]];
+                if (probability <= 0.0) {
+                    ++result.invalid_rows;
+                    return;
+                }
+                log_likelihood += std::log(probability);
+            }
+            result.log_likelihood += log_likelihood;
+            return;
+        }
+
+        missing_families.clear();
+        for (int v = 0; v < bn.next_id; ++v) {
+            if (!familyObserved(layout, v, observed)) missing_families.push_back(v);
+        }
+        double prob_evidence = engine.computeFamilyMarginals(observed, missing_families, family_marginals);
+        if (prob_evidence <= 0.0) {
+            ++result.invalid_rows;
+            return;
+        }
+        result.log_likelihood += std::log(prob_evidence);
+
+        for (int v : missing_families) {
+            const std::vector<double>& posterior = family_marginals[v];
+            for (size_t i = 0; i < posterior.size(); ++i) {
+                result.counts[v][i] += posterior[i];
+            }
+        }
+    });
+}
+
+} // namespace
+
+bool learnParameters(BayesianNetwork& bn, const std::string& data_file, const LearningOptions& options, LearningStats* stats) {
+    auto start_time = std::chrono::steady_clock::now();
+
+    size_t mapped_size = 0;
+    const void* mapped = mapReadOnly(data_file, mapped_size);
+    if (!mapped) {
+        if (std::ifstream(data_file).is_open()) {
+            std::cerr << "Error: " << data_file << " is empty" << std::endl;
+        } else {
+            std::cerr << "Error: Could not open file " << data_file << std::endl;
+        }
+        return false;
+    }
+    // La mappatura e' rilasciata all'uscita, qualunque sia il percorso
+    std::shared_ptr<const void> mapping(mapped, [mapped_size](const void* data) { unmapReadOnly(data, mapped_size); });
+    DataFile file;
+    file.data = static_cast<const char*>(mapped);
+    file.size = static_cast<long long>(mapped_size);
+    const long long file_size = file.size;
+    const char* header_end = static_cast<const char*>(std::memchr(file.data, '\n', mapped_size));
+    std::string header(file.data, header_end ? header_end : file.data + mapped_size);
+    long long data_start = static_cast<long long>(header.size()) + 1;
+
+    CaseColumns columns = mapCaseColumns(bn, splitCSVLine(header));
+    FamilyLayout layout = buildFamilyLayout(bn);
+
+    int threads = options.threads > 0 ? options.threads : static_cast<int>(std::thread::hardware_concurrency());
+    if (threads <= 0) threads = 1;
+    std::vector<FileSlice> slices = sliceDataFile(data_start, file_size, threads);
+
+    // Pass 1: per-thread counts of the observed families, merged at the end
+    std::vector<CountingResult> partial_counts(threads);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.push_back(std::thread(countObservedFamilies, std::cref(bn), std::cref(layout), std::cref(columns),
+                                      std::cref(file), slices[t], data_start, std::ref(partial_counts[t])));
+    }
+    for (std::thread& worker : workers) worker.join();
+
+    SufficientStatistics observed_counts = emptyStatistics(layout);
+    LearningStats result;
+    for (const CountingResult& partial : partial_counts) {
+        addStatistics(observed_counts, partial.counts);
+        result.rows += partial.rows;
+        result.incomplete_rows += partial.incomplete_rows;
+        result.invalid_rows += partial.invalid_rows;
+    }
+    partial_counts.clear();
+    setCPTsFromStatistics(bn, layout, observed_counts, options.alpha);
+
+    // EM: the observed counts stay fixed, only the expected counts of the missing families are recomputed
+    if (options.em && result.incomplete_rows > 0) {
+        long long cache_budget = (options.mem_limit >= 0 ? options.mem_limit : DEFAULT_CACHE_BUDGET_BYTES) / threads;
+        double previous_log_likelihood = 0.0;
+        for (int iteration = 1; iteration <= options.em_iterations; ++iteration) {
+            std::vector<ExpectationResult> partial_expectations(threads);
+            workers.clear();
+            for (int t = 0; t < threads; ++t) {
+                workers.push_back(std::thread(expectedFamilyCounts, std::cref(bn), std::cref(layout), std::cref(columns),
+                                              std::cref(file), slices[t], data_start, cache_budget,
+                                              std::ref(partial_expectations[t])));
+            }
+            for (std::thread& worker : workers) worker.join();
+
+            SufficientStatistics total_counts = observed_counts;
+            double log_likelihood = 0.0;
+            long long zero_probability_rows = 0;
+            for (const ExpectationResult& partial : partial_expectations) {
+                addStatistics(total_counts, partial.counts);
+                log_likelihood += partial.log_likelihood;
+                zero_probability_rows += partial.invalid_rows;
+            }
+            setCPTsFromStatistics(bn, layout, total_counts, options.alpha);
+
+            result.em_iterations = iteration;
+            result.log_likelihood = log_likelihood;
+            if (zero_probability_rows > 0) {
+                std::cerr << "Warning: " << zero_probability_rows << " rows have zero probability at EM iteration " << iteration << std::endl;
+            }
+            if (iteration > 1 && std::fabs(log_likelihood - previous_log_likelihood) <= options.em_tolerance * std::fabs(previous_log_likelihood)) {
+                break;
+            }
+            previous_log_likelihood = log_likelihood;
+        }
+    }
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    if (stats) {
+        *stats = result;
+    }
+    return true;
+}
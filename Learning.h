@@ -0,0 +1,30 @@
+#ifndef LEARNING_H
+#define LEARNING_H
+
+#include "BayesianNetwork.h"
+
+// Options for learning the CPTs of a fixed structure from a CSV data file
+struct LearningOptions {
+    double alpha = 1.0;             // Dirichlet pseudo-count added to every CPT entry (1 = Laplace, 0 = maximum likelihood)
+    int threads = 0;                // worker threads, 0 = hardware concurrency
+    bool em = false;                // EM for rows with missing values (otherwise only fully observed families are counted)
+    int em_iterations = 20;
+    double em_tolerance = 1e-5;     // stop when the relative log-likelihood improvement is smaller
+    long long mem_limit = -1;       // cache budget shared by the recursive conditioning engines of the E-step, -1 = DEFAULT_CACHE_BUDGET_BYTES
+};
+
+struct LearningStats {
+    long long rows = 0;
+    long long incomplete_rows = 0;  // rows with at least one missing value
+    long long invalid_rows = 0;     // wrong number of fields, unknown values or zero probability
+    int em_iterations = 0;
+    double log_likelihood = 0.0;    // of the data under the learned parameters (EM only)
+    double seconds = 0.0;
+};
+
+// Learns the CPTs of bn (structure unchanged) from data_file and stores them as dense tables.
+// Every thread counts a slice of the file into its own sufficient statistics, merged at the end.
+bool learnParameters(BayesianNetwork& bn, const std::string& data_file, const LearningOptions& options,
+                     LearningStats* stats = nullptr);
+
+#endif // LEARNING_H
@@ -0,0 +1,525 @@
+// LoopCutset.cpp
+#include "LoopCutset.h"
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+std::vector<int> find_loop_cutset(const BayesianNetwork& bn) {
+    const int n = bn.next_id;
+    std::vector<std::set<int>> parents(n);
+    std::vector<std::set<int>> children(n);
+    std::vector<int> cardinality(n, 1);
+    for (const auto& pair : bn.variables) {
+        const Variable& var = pair.second;
+        cardinality[var.id] = static_cast<int>(var.values.size());
+        for (const std::string& parent_name : var.parents) {
+            int parent_id = bn.name_to_id.at(parent_name);
+            parents[var.id].insert(parent_id);
+            children[parent_id].insert(var.id);
+        }
+    }
+
+    std::vector<bool> removed(n, false);
+    auto remove_node = [&](int v) {
+        for (int p : parents[v]) children[p].erase(v);
+        for (int c : children[v]) parents[c].erase(v);
+        parents[v].clear();
+        children[v].clear();
+        removed[v] = true;
+    };
+
+    std::vector<int> cutset;
+    while (true) {
+        // 1. I nodi di grado <= 1 non possono stare su nessun ciclo
+        bool stripped = true;
+        while (stripped) {
+            stripped = false;
+            for (int v = 0; v < n; ++v) {
+                if (!removed[v] && parents[v].size() + children[v].size() <= 1) {
+                    remove_node(v);
+                    stripped = true;
+                }
+            }
+        }
+
+        // 2. Tra i nodi con al piu' un genitore rimasto, condiziona su quello di grado massimo
+        //    (a parita', cardinalita' minore: meno istanziazioni da enumerare)
+        int best = -1;
+        for (int v = 0; v < n; ++v) {
+            if (removed[v] || parents[v].size() > 1) continue;
+            size_t degree = parents[v].size() + children[v].size();
+            size_t best_degree = best < 0 ? 0 : parents[best].size() + children[best].size();
+            if (best < 0 || degree > best_degree || (degree == best_degree && cardinality[v] < cardinality[best])) {
+                best = v;
+            }
+        }
+        if (best < 0) break; // grafo vuoto (un DAG non vuoto ha sempre una sorgente)
+        cutset.push_back(best);
+        remove_node(best);
+    }
+    return cutset;
+}
+
+namespace {
+
+// Struttura del polialbero ottenuto togliendo gli archi uscenti dai nodi del cutset.
+// I messaggi seguono lo schema di Pearl: pi dai genitori, lambda dai figli.
+struct PolytreeStructure {
+    std::vector<const Variable*> variables;
+    std::vector<int> cardinality;
+    std::vector<std::vector<int>> parent_ids;      // all parents, in the order of Variable::parents
+    std::vector<std::vector<int>> parent_cards;
+    std::vector<std::vector<int>> active_parents;  // positions in parent_ids of the parents outside the cutset
+    std::vector<std::vector<int>> children;        // children in the polytree (none for cutset nodes)
+    std::vector<std::vector<int>> parent_slot;     // [X][k]: index of X in children[active parent k]
+    std::vector<std::vector<int>> child_slot;      // [X][j]: index of X in active_parents[children[X][j]]
+    std::vector<int> schedule;                     // BFS order, component by component
+    std::vector<int> up_parent;                    // active parent k towards the BFS root, -1 if none
+    std::vector<int> up_child;                     // child j towards the BFS root, -1 if none
+};
+
+PolytreeStructure buildPolytree(const BayesianNetwork& bn, const std::vector<bool>& in_cutset) {
+    const int n = bn.next_id;
+    PolytreeStructure pt;
+    pt.variables.resize(n);
+    pt.cardinality.resize(n);
+    pt.parent_ids.resize(n);
+    pt.parent_cards.resize(n);
+    pt.active_parents.resize(n);
+    pt.children.resize(n);
+    pt.parent_slot.resize(n);
+    pt.child_slot.resize(n);
+    for (const auto& pair : bn.variables) {
+        pt.variables[pair.second.id] = &pair.second;
+        pt.cardinality[pair.second.id] = static_cast<int>(pair.second.values.size());
+    }
+    for (int x = 0; x < n; ++x) {
+        for (const std::string& parent_name : pt.variables[x]->parents) {
+            int parent_id = bn.name_to_id.at(parent_name);
+            pt.parent_ids[x].push_back(parent_id);
+            pt.parent_cards[x].push_back(pt.cardinality[parent_id]);
+            if (!in_cutset[parent_id]) {
+                pt.active_parents[x].push_back(static_cast<int>(pt.parent_ids[x].size()) - 1);
+                pt.parent_slot[x].push_back(static_cast<int>(pt.children[parent_id].size()));
+                pt.child_slot[parent_id].push_back(static_cast<int>(pt.active_parents[x].size()) - 1);
+                pt.children[parent_id].push_back(x);
+            }
+        }
+    }
+
+    // Visita in ampiezza di ogni componente: il primo nodo visitato fa da radice
+    pt.up_parent.assign(n, -1);
+    pt.up_child.assign(n, -1);
+    std::vector<bool> visited(n, false);
+    for (int root = 0; root < n; ++root) {
+        if (visited[root]) continue;
+        visited[root] = true;
+        size_t head = pt.schedule.size();
+        pt.schedule.push_back(root);
+        while (head < pt.schedule.size()) {
+            int x = pt.schedule[head++];
+            for (size_t k = 0; k < pt.active_parents[x].size(); ++k) {
+                int u = pt.parent_ids[x][pt.active_parents[x][k]];
+                if (visited[u]) continue;
+                visited[u] = true;
+                pt.up_child[u] = pt.parent_slot[x][k]; // u reaches the root through its child x
+                pt.schedule.push_back(u);
+            }
+            for (size_t j = 0; j < pt.children[x].size(); ++j) {
+                int y = pt.children[x][j];
+                if (visited[y]) continue;
+                visited[y] = true;
+                pt.up_parent[y] = pt.child_slot[x][j]; // y reaches the root through its parent x
+                pt.schedule.push_back(y);
+            }
+        }
+    }
+    return pt;
+}
+
+// Una propagazione sul polialbero per un'istanziazione del cutset. Ogni thread ne ha una propria.
+class PolytreePass {
+public:
+    explicit PolytreePass(const PolytreeStructure& structure) : pt_(structure) {
+        const size_t n = pt_.variables.size();
+        pi_in_.resize(n);
+        lambda_in_.resize(n);
+        parent_values_.resize(n);
+        for (size_t x = 0; x < n; ++x) {
+            pi_in_[x].resize(pt_.active_parents[x].size());
+            for (size_t k = 0; k < pt_.active_parents[x].size(); ++k) {
+                pi_in_[x][k].assign(pt_.parent_cards[x][pt_.active_parents[x][k]], 1.0);
+            }
+            lambda_in_[x].assign(pt_.children[x].size(), std::vector<double>(pt_.cardinality[x], 1.0));
+            parent_values_[x].resize(pt_.parent_ids[x].size());
+        }
+        beliefs_.resize(n);
+    }
+
+    // values[X] = evidence or cutset value, -1 if free. Returns log P(e, c), -inf if impossible.
+    // On success beliefs()[X] holds P(X | e, c).
+    double run(const std::vector<int>& values) {
+        values_ = &values;
+        double log_z = 0.0;
+        std::vector<double> message;
+
+        // Raccolta: dalle foglie verso le radici, tenendo traccia delle normalizzazioni
+        for (size_t i = pt_.schedule.size(); i-- > 0;) {
+            int x = pt_.schedule[i];
+            double norm = 0.0;
+            if (pt_.up_parent[x] >= 0) {
+                norm = sendToParent(x, pt_.up_parent[x]);
+            } else if (pt_.up_child[x] >= 0) {
+                norm = sendToChild(x, pt_.up_child[x]);
+            } else {
+                // Radice: Z della componente = sum_x pi(x) lambda(x)
+                computeBelief(x);
+                for (double b : beliefs_[x]) norm += b;
+            }
+            if (norm <= 0.0) return -std::numeric_limits<double>::infinity();
+            log_z += std::log(norm);
+        }
+
+        // Distribuzione: dalle radici verso le foglie (normalizzazioni libere)
+        for (int x : pt_.schedule) {
+            for (size_t k = 0; k < pt_.active_parents[x].size(); ++k) {
+                if (static_cast<int>(k) != pt_.up_parent[x]) sendToParent(x, static_cast<int>(k));
+            }
+            for (size_t j = 0; j < pt_.children[x].size(); ++j) {
+                if (static_cast<int>(j) != pt_.up_child[x]) sendToChild(x, static_cast<int>(j));
+            }
+        }
+
+        for (size_t x = 0; x < beliefs_.size(); ++x) {
+            computeBelief(static_cast<int>(x));
+            double sum = 0.0;
+            for (double b : beliefs_[x]) sum += b;
+            for (double& b : beliefs_[x]) b = sum > 0.0 ? b / sum : 0.0;
+        }
+        return log_z;
+    }
+
+    const std::vector<std::vector<double>>& beliefs() const { return beliefs_; }
+
+private:
+    const PolytreeStructure& pt_;
+    const std::vector<int>* values_ = nullptr;
+    std::vector<std::vector<std::vector<double>>> pi_in_;      // [X][k] message from active parent k
+    std::vector<std::vector<std::vector<double>>> lambda_in_;  // [X][j] message from child j
+    std::vector<std::vector<int>> parent_values_;
+    std::vector<std::vector<double>> beliefs_;
+    std::vector<double> pi_, lambda_, out_;
+
+    double indicator(int x, int value) const {
+        int fixed = (*values_)[x];
+        return fixed < 0 || fixed == value ? 1.0 : 0.0;
+    }
+
+    // lambda(x) = indicatore dell'evidenza * prodotto dei messaggi dei figli (escluso skip_child)
+    void computeLambda(int x, int skip_child, std::vector<double>& lambda) const {
+        lambda.assign(pt_.cardinality[x], 0.0);
+        for (int v = 0; v < pt_.cardinality[x]; ++v) {
+            double value = indicator(x, v);
+            for (size_t j = 0; j < lambda_in_[x].size() && value != 0.0; ++j) {
+                if (static_cast<int>(j) != skip_child) value *= lambda_in_[x][j][v];
+            }
+            lambda[v] = value;
+        }
+    }
+
+    void computeBelief(int x) {
+        familySum(x, -1, lambda_, pi_);
+        computeLambda(x, -1, lambda_);
+        beliefs_[x].resize(pt_.cardinality[x]);
+        for (int v = 0; v < pt_.cardinality[x]; ++v) beliefs_[x][v] = pi_[v] * lambda_[v];
+    }
+
+    double normalizeInto(const std::vector<double>& message, std::vector<double>& target) {
+        double norm = 0.0;
+        for (double m : message) norm += m;
+        target.resize(message.size());
+        for (size_t i = 0; i < message.size(); ++i) target[i] = norm > 0.0 ? message[i] / norm : 0.0;
+        return norm;
+    }
+
+    // pi message to child j: pi(x) * lambda(x) without the child's own message
+    double sendToChild(int x, int j) {
+        familySum(x, -1, lambda_, pi_);
+        computeLambda(x, j, lambda_);
+        for (int v = 0; v < pt_.cardinality[x]; ++v) pi_[v] *= lambda_[v];
+        int child = pt_.children[x][j];
+        return normalizeInto(pi_, pi_in_[child][pt_.child_slot[x][j]]);
+    }
+
+    // lambda message to active parent k
+    double sendToParent(int x, int k) {
+        computeLambda(x, -1, lambda_);
+        familySum(x, k, lambda_, out_);
+        int parent = pt_.parent_ids[x][pt_.active_parents[x][k]];
+        return normalizeInto(out_, lambda_in_[parent][pt_.parent_slot[x][k]]);
+    }
+
+    // Somma sulla famiglia di X. Con to_parent < 0 calcola pi(x) = sum_u P(x|u) prod_k pi_k(u_k);
+    // altrimenti il messaggio verso il genitore attivo to_parent:
+    //   out(u_k) = sum_x lambda(x) sum_{u senza u_k} P(x|u) prod_{k' != k} pi_k'(u_k')
+    void familySum(int x, int to_parent, const std::vector<double>& lambda, std::vector<double>& out) {
+        const Variable& var = *pt_.variables[x];
+        if (var.cpt_kind == CPTKind::NoisyOR || var.cpt_kind == CPTKind::NoisyMAX) {
+            noisyFamilySum(x, to_parent, lambda, out);
+            return;
+        }
+
+        const std::vector<int>& active = pt_.active_parents[x];
+        std::vector<int>& parent_values = parent_values_[x];
+        const int card = pt_.cardinality[x];
+        out.assign(to_parent < 0 ? card : pt_.parent_cards[x][active[to_parent]], 0.0);
+
+        // I genitori nel cutset sono fissati al loro valore, gli altri vengono enumerati
+        for (size_t i = 0; i < parent_values.size(); ++i) {
+            int fixed = (*values_)[pt_.parent_ids[x][i]];
+            parent_values[i] = fixed >= 0 ? fixed : 0;
+        }
+        for (int k : active) parent_values[k] = 0;
+
+        while (true) {
+            double weight = 1.0;
+            for (size_t k = 0; k < active.size() && weight != 0.0; ++k) {
+                if (static_cast<int>(k) != to_parent) weight *= pi_in_[x][k][parent_values[active[k]]];
+            }
+            if (weight != 0.0) {
+                if (to_parent < 0) {
+                    for (int v = 0; v < card; ++v) {
+                        out[v] += weight * getProbabilityFromParentValues(var, parent_values, pt_.parent_cards[x], v);
+                    }
+                } else {
+                    double sum = 0.0;
+                    for (int v = 0; v < card; ++v) {
+                        if (lambda[v] != 0.0) sum += lambda[v] * getProbabilityFromParentValues(var, parent_values, pt_.parent_cards[x], v);
+                    }
+                    out[parent_values[active[to_parent]]] += weight * sum;
+                }
+            }
+
+            size_t k = 0;
+            while (k < active.size() && ++parent_values[active[k]] == pt_.parent_cards[x][active[k]]) {
+                parent_values[active[k]] = 0;
+                ++k;
+            }
+            if (k == active.size()) break;
+        }
+    }
+
+    // Decomposizione causale del noisy-MAX: P(grado <= d | u) = C_leak(d) prod_i C_{i,u_i}(d),
+    // quindi la somma sui genitori si fattorizza e costa O(genitori) invece di O(prod cardinalita').
+    void noisyFamilySum(int x, int to_parent, const std::vector<double>& lambda, std::vector<double>& out) {
+        const Variable& var = *pt_.variables[x];
+        const int card = pt_.cardinality[x];
+        const std::vector<int>& active = pt_.active_parents[x];
+
+        // offset dei parametri di ogni genitore dentro cpt_params
+        std::vector<size_t> offsets(pt_.parent_ids[x].size());
+        size_t offset = card;
+        for (size_t i = 0; i < offsets.size(); ++i) {
+            offsets[i] = offset;
+            offset += static_cast<size_t>(pt_.parent_cards[x][i]) * card;
+        }
+        const double* params = var.cpt_params.data();
+
+        // fixed_part[d] = C_leak(d) * prodotto sui genitori del cutset
+        // expected[k][d] = sum_u pi_k(u) C_{k,u}(d) per i genitori attivi
+        std::vector<double> fixed_part(card);
+        std::vector<std::vector<double>> expected(active.size(), std::vector<double>(card, 0.0));
+        for (int d = 0; d < card; ++d) {
+            fixed_part[d] = noisyCumulative(params, card, d);
+            for (size_t i = 0; i < offsets.size(); ++i) {
+                int fixed = (*values_)[pt_.parent_ids[x][i]];
+                bool is_active = std::find(active.begin(), active.end(), static_cast<int>(i)) != active.end();
+                if (!is_active) fixed_part[d] *= noisyCumulative(params + offsets[i] + static_cast<size_t>(fixed) * card, card, d);
+            }
+            for (size_t k = 0; k < active.size(); ++k) {
+                int i = active[k];
+                for (int u = 0; u < pt_.parent_cards[x][i]; ++u) {
+                    expected[k][d] += pi_in_[x][k][u] * noisyCumulative(params + offsets[i] + static_cast<size_t>(u) * card, card, d);
+                }
+            }
+        }
+
+        if (to_parent < 0) {
+            // F(d) = fixed_part(d) prod_k expected_k(d); pi(valore di grado d) = F(d) - F(d-1)
+            std::vector<double> cumulative(card);
+            for (int d = 0; d < card; ++d) {
+                cumulative[d] = fixed_part[d];
+                for (size_t k = 0; k < active.size(); ++k) cumulative[d] *= expected[k][d];
+            }
+            out.assign(card, 0.0);
+            for (int d = 0; d < card; ++d) {
+                out[card - 1 - d] = cumulative[d] - (d > 0 ? cumulative[d - 1] : 0.0);
+            }
+            return;
+        }
+
+        int i = active[to_parent];
+        std::vector<double> others(card);
+        for (int d = 0; d < card; ++d) {
+            others[d] = fixed_part[d];
+            for (size_t k = 0; k < active.size(); ++k) {
+                if (static_cast<int>(k) != to_parent) others[d] *= expected[k][d];
+            }
+        }
+        out.assign(pt_.parent_cards[x][i], 0.0);
+        for (int u = 0; u < pt_.parent_cards[x][i]; ++u) {
+            const double* link = params + offsets[i] + static_cast<size_t>(u) * card;
+            double previous = 0.0;
+            for (int d = 0; d < card; ++d) {
+                double cumulative = others[d] * noisyCumulative(link, card, d);
+                out[u] += lambda[card - 1 - d] * (cumulative - previous);
+                previous = cumulative;
+            }
+        }
+    }
+};
+
+// Somme pesate da P(e, c) tenute in scala logaritmica per evitare underflow
+struct WeightedBeliefs {
+    double log_scale = -std::numeric_limits<double>::infinity();
+    double total = 0.0;
+    std::vector<std::vector<double>> sums;
+
+    void rescale(double new_log_scale) {
+        double factor = std::exp(log_scale - new_log_scale);
+        total *= factor;
+        for (auto& row : sums) for (double& s : row) s *= factor;
+        log_scale = new_log_scale;
+    }
+
+    void add(double log_weight, const std::vector<std::vector<double>>& beliefs) {
+        if (sums.empty()) {
+            sums.resize(beliefs.size());
+            for (size_t x = 0; x < beliefs.size(); ++x) sums[x].assign(beliefs[x].size(), 0.0);
+        }
+        if (log_weight > log_scale) rescale(log_weight);
+        double weight = std::exp(log_weight - log_scale);
+        total += weight;
+        for (size_t x = 0; x < beliefs.size(); ++x) {
+            for (size_t v = 0; v < beliefs[x].size(); ++v) sums[x][v] += weight * beliefs[x][v];
+        }
+    }
+
+    void merge(const WeightedBeliefs& other) {
+        if (other.sums.empty()) return;
+        if (sums.empty()) {
+            *this = other;
+            return;
+        }
+        double factor;
+        if (other.log_scale > log_scale) {
+            rescale(other.log_scale);
+            factor = 1.0;
+        } else {
+            factor = std::exp(other.log_scale - log_scale);
+        }
+        total += factor * other.total;
+        for (size_t x = 0; x < sums.size(); ++x) {
+            for (size_t v = 0; v < sums[x].size(); ++v) sums[x][v] += factor * other.sums[x][v];
+        }
+    }
+};
+
+} // namespace
+
+long long countCutsetInstantiations(const BayesianNetwork& bn, const std::vector<int>& cutset,
+                                    const std::vector<int>& observed, long long max_instantiations) {
+    long long instantiations = 1;
+    for (int c : cutset) {
+        if (c < static_cast<int>(observed.size()) && observed[c] >= 0) continue;
+        long long card = static_cast<long long>(bn.variables.at(bn.id_to_name.at(c)).values.size());
+        if (card > 0 && instantiations > max_instantiations / card) return -1;
+        instantiations *= card;
+    }
+    return instantiations;
+}
+
+std::map<std::string, std::map<std::string, double>> calculateProbabilitiesWithLoopCutset(
+    const BayesianNetwork& bn,
+    const Evidence& evidence,
+    int threads,
+    LoopCutsetStats* stats,
+    long long max_instantiations
+) {
+    std::vector<int> observed = evidenceToValues(bn, evidence);
+    std::vector<int> cutset = find_loop_cutset(bn);
+    if (stats) {
+        stats->cutset.clear();
+        for (int c : cutset) stats->cutset.push_back(bn.id_to_name.at(c));
+    }
+
+    // Istanziazioni del cutset coerenti con l'evidenza, numerate in base mista
+    long long instantiations = countCutsetInstantiations(bn, cutset, observed, max_instantiations);
+    if (instantiations < 0) {
+        std::cerr << "Error: the loop cutset (" << cutset.size() << " variables) has more than "
+                  << max_instantiations << " instantiations" << std::endl;
+        if (stats) stats->instantiations = -1;
+        return std::map<std::string, std::map<std::string, double>>();
+    }
+    std::vector<int> free_cutset;
+    for (int c : cutset) {
+        if (observed[c] < 0) free_cutset.push_back(c);
+    }
+    std::vector<bool> in_cutset(bn.next_id, false);
+    for (int c : cutset) in_cutset[c] = true;
+    PolytreeStructure structure = buildPolytree(bn, in_cutset);
+
+    if (threads <= 0) threads = static_cast<int>(std::thread::hardware_concurrency());
+    if (threads <= 0) threads = 1;
+    if (static_cast<long long>(threads) > instantiations) threads = static_cast<int>(instantiations);
+
+    std::atomic<long long> next_instantiation(0);
+    const long long chunk = 16;
+    std::vector<WeightedBeliefs> partial(threads);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.push_back(std::thread([&, t]() {
+            PolytreePass pass(structure);
+            std::vector<int> values = observed;
+            while (true) {
+                long long first = next_instantiation.fetch_add(chunk);
+                if (first >= instantiations) break;
+                long long last = std::min(first + chunk, instantiations);
+                for (long long index = first; index < last; ++index) {
+                    long long rest = index;
+                    for (int c : free_cutset) {
+                        values[c] = static_cast<int>(rest % structure.cardinality[c]);
+                        rest /= structure.cardinality[c];
+                    }
+                    double log_weight = pass.run(values);
+                    if (log_weight > -std::numeric_limits<double>::infinity()) {
+                        partial[t].add(log_weight, pass.beliefs());
+                    }
+                }
+            }
+        }));
+    }
+    for (std::thread& worker : workers) worker.join();
+
+    WeightedBeliefs combined;
+    for (const WeightedBeliefs& p : partial) combined.merge(p);
+
+    std::map<std::string, std::map<std::string, double>> marginal_probabilities;
+    for (const auto& pair : bn.variables) {
+        const Variable& var = pair.second;
+        for (size_t v = 0; v < var.values.size(); ++v) {
+            double p = combined.total > 0.0 ? combined.sums[var.id][v] / combined.total : 0.0;
+            marginal_probabilities[var.name][var.values[v]] = p;
+        }
+    }
+
+    if (stats) {
+        stats->instantiations = instantiations;
+        stats->threads = threads;
+        stats->prob_evidence = combined.total > 0.0 ? combined.total * std::exp(combined.log_scale) : 0.0;
+    }
+    return marginal_probabilities;
+}
@@ -0,0 +1,38 @@
+#ifndef LOOP_CUTSET_H
+#define LOOP_CUTSET_H
+
+#include "BayesianNetwork.h"
+
+// Largest number of cutset instantiations (polytree passes) the engine accepts
+const long long MAX_CUTSET_INSTANTIATIONS = 1LL << 20;
+
+struct LoopCutsetStats {
+    std::vector<std::string> cutset;
+    long long instantiations = 0;   // cutset instantiations consistent with the evidence, -1 if over the limit
+    int threads = 0;
+    double prob_evidence = 0.0;
+};
+
+// Greedy loop cutset (Suermondt-Cooper): repeatedly strips nodes of degree <= 1 and then
+// conditions on the node with the highest degree among those with at most one parent left.
+// Removing the outgoing edges of the returned IDs turns the network into a polytree.
+std::vector<int> find_loop_cutset(const BayesianNetwork& bn);
+
+// Instantiations of cutset consistent with observed (value index by ID, -1 = free), or -1 if there
+// are more than max_instantiations: the product is checked before every multiplication, so it never overflows
+long long countCutsetInstantiations(const BayesianNetwork& bn, const std::vector<int>& cutset,
+                                    const std::vector<int>& observed, long long max_instantiations);
+
+// Exact inference by loop cutset conditioning: one polytree belief propagation pass per
+// cutset instantiation, distributed across threads (0 = hardware concurrency) and
+// combined with weights P(e, c). Memory stays linear in the size of the network.
+// With more than max_instantiations cutset instantiations nothing is run: the result is empty
+// and stats->instantiations is -1 (check countCutsetInstantiations first to pick another engine).
+std::map<std::string, std::map<std::string, double>> calculateProbabilitiesWithLoopCutset(
+    const BayesianNetwork& bn,
+    const Evidence& evidence,
+    int threads = 0,
+    LoopCutsetStats* stats = nullptr,
+    long long max_instantiations = MAX_CUTSET_INSTANTIATIONS);
+
+#endif // LOOP_CUTSET_H
@@ -0,0 +1,493 @@
+// MiniBucket.cpp
+#include "MiniBucket.h"
+#include "PlanCache.h"
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const double NEG_INF = -std::numeric_limits<double>::infinity();
+
+// Le tabelle controllano la scadenza ogni DEADLINE_CHECK_MASK + 1 righe, cosi' anche una tabella
+// enorme viene abbandonata in tempo e il costo di Clock::now() resta trascurabile
+const size_t DEADLINE_CHECK_MASK = 4095;
+
+bool pastDeadline(const Clock::time_point* deadline, size_t row) {
+    return deadline && (row & DEADLINE_CHECK_MASK) == 0 && Clock::now() > *deadline;
+}
+
+// Tabella su un insieme di variabili: l'ultima variabile dello scope varia piu' velocemente,
+// come nelle righe delle CPT (primo genitore piu' significativo, poi il valore del figlio)
+struct Factor {
+    std::vector<int> scope;
+    std::vector<double> table;
+};
+
+enum class BoundMode { Upper, Lower, Estimate };
+enum class EliminationOp { Sum, Max, Min, Mean };
+
+struct Model {
+    std::vector<const Variable*> variables;
+    std::vector<int> cardinality;
+    std::vector<std::vector<int>> parent_ids;
+    std::vector<std::vector<int>> parent_cards;
+    std::vector<int> order;
+    std::vector<int> position;      // position of each ID in the elimination order
+    int largest_family = 1;         // variables of the largest CPT: the smallest usable i-bound
+};
+
+Model buildModel(const BayesianNetwork& bn) {
+    Model model;
+    const int n = bn.next_id;
+    model.variables.resize(n);
+    model.cardinality.resize(n);
+    model.parent_ids.resize(n);
+    model.parent_cards.resize(n);
+    for (const auto& pair : bn.variables) {
+        model.variables[pair.second.id] = &pair.second;
+        model.cardinality[pair.second.id] = static_cast<int>(pair.second.values.size());
+    }
+    for (int x = 0; x < n; ++x) {
+        for (const std::string& parent_name : model.variables[x]->parents) {
+            int parent_id = bn.name_to_id.at(parent_name);
+            model.parent_ids[x].push_back(parent_id);
+            model.parent_cards[x].push_back(model.cardinality[parent_id]);
+        }
+        model.largest_family = std::max(model.largest_family, static_cast<int>(model.parent_ids[x].size()) + 1);
+    }
+    model.order = planned_elimination_order(bn);
+    model.position.assign(n, 0);
+    for (size_t i = 0; i < model.order.size(); ++i) {
+        model.position[model.order[i]] = static_cast<int>(i);
+    }
+    return model;
+}
+
+// CPT of X restricted to the fixed values (evidence and the clamped query value);
+// false if the deadline passed while the table was being filled
+bool familyFactor(const Model& model, int x, const std::vector<int>& values,
+                  const Clock::time_point* deadline, Factor& factor) {
+    std::vector<int> family = model.parent_ids[x];
+    family.push_back(x);
+
+    std::vector<size_t> free_positions;
+    std::vector<int> assignment(family.size());
+    for (size_t k = 0; k < family.size(); ++k) {
+        int fixed = values[family[k]];
+        assignment[k] = fixed >= 0 ? fixed : 0;
+        if (fixed < 0) {
+            factor.scope.push_back(family[k]);
+            free_positions.push_back(k);
+        }
+    }
+
+    std::vector<int> parent_values(model.parent_ids[x].size());
+    while (true) {
+        if (pastDeadline(deadline, factor.table.size())) return false;
+        std::copy(assignment.begin(), assignment.end() - 1, parent_values.begin());
+        factor.table.push_back(getProbabilityFromParentValues(*model.variables[x], parent_values,
+                                                              model.parent_cards[x], assignment.back()));
+        size_t k = free_positions.size();
+        while (k > 0) {
+            size_t position = free_positions[k - 1];
+            if (++assignment[position] < model.cardinality[family[position]]) break;
+            assignment[position] = 0;
+            --k;
+        }
+        if (k == 0) break;
+    }
+    return true;
+}
+
+// Moltiplica i fattori ed elimina x con l'operatore dato; false se la scadenza arriva a meta' tabella
+bool combineEliminate(const Model& model, const std::vector<const Factor*>& factors, int x, EliminationOp op,
+                      const Clock::time_point* deadline, Factor& result) {
+    for (const Factor* factor : factors) {
+        for (int v : factor->scope) {
+            if (v != x) result.scope.push_back(v);
+        }
+    }
+    std::sort(result.scope.begin(), result.scope.end());
+    result.scope.erase(std::unique(result.scope.begin(), result.scope.end()), result.scope.end());
+
+    const size_t n_factors = factors.size();
+    const size_t n_vars = result.scope.size();
+    std::vector<std::vector<size_t>> strides(n_factors, std::vector<size_t>(n_vars, 0));
+    std::vector<size_t> x_stride(n_factors, 0);
+    for (size_t f = 0; f < n_factors; ++f) {
+        size_t stride = 1;
+        const std::vector<int>& scope = factors[f]->scope;
+        for (size_t k = scope.size(); k-- > 0;) {
+            if (scope[k] == x) {
+                x_stride[f] = stride;
+            } else {
+                size_t index = std::lower_bound(result.scope.begin(), result.scope.end(), scope[k]) - result.scope.begin();
+                strides[f][index] = stride;
+            }
+            stride *= model.cardinality[scope[k]];
+        }
+    }
+
+    size_t entries = 1;
+    for (int v : result.scope) entries *= model.cardinality[v];
+    result.table.resize(entries);
+
+    const int card_x = model.cardinality[x];
+    std::vector<int> assignment(n_vars, 0);
+    std::vector<size_t> offset(n_factors, 0);
+    for (size_t e = 0; e < entries; ++e) {
+        if (pastDeadline(deadline, e)) return false;
+        double accumulated = op == EliminationOp::Min ? std::numeric_limits<double>::infinity() : 0.0;
+        for (int xv = 0; xv < card_x; ++xv) {
+            double product = 1.0;
+            for (size_t f = 0; f < n_factors; ++f) {
+                product *= factors[f]->table[offset[f] + xv * x_stride[f]];
+            }
+            switch (op) {
+                case EliminationOp::Sum:
+                case EliminationOp::Mean: accumulated += product; break;
+                case EliminationOp::Max: accumulated = std::max(accumulated, product); break;
+                case EliminationOp::Min: accumulated = std::min(accumulated, product); break;
+            }
+        }
+        if (op == EliminationOp::Mean) accumulated /= card_x;
+        result.table[e] = accumulated;
+
+        for (size_t k = n_vars; k-- > 0;) {
+            for (size_t f = 0; f < n_factors; ++f) offset[f] += strides[f][k];
+            if (++assignment[k] < model.cardinality[result.scope[k]]) break;
+            for (size_t f = 0; f < n_factors; ++f) offset[f] -= strides[f][k] * model.cardinality[result.scope[k]];
+            assignment[k] = 0;
+        }
+    }
+    return true;
+}
+
+struct EliminationResult {
+    double log_value = 0.0;
+    bool split = false;             // some bucket needed more than one mini-bucket
+    bool timed_out = false;
+    long long max_table_entries = 0;
+};
+
+// Mini-bucket elimination of all the variables; the messages are rescaled to a maximum of 1
+// and the scale factors accumulated in log_value, so long chains of evidence do not underflow.
+// The deadline is checked before every bucket and every few thousand rows of every table.
+EliminationResult eliminate(const Model& model, const std::vector<Factor>& initial, int i_bound,
+                            BoundMode mode, const Clock::time_point* deadline) {
+    EliminationResult result;
+    std::vector<std::vector<Factor>> buckets(model.order.size());
+    auto place = [&](Factor&& factor) {
+        if (factor.scope.empty()) {
+            result.log_value += factor.table[0] > 0.0 ? std::log(factor.table[0]) : NEG_INF;
+            return;
+        }
+        int first = model.position[factor.scope[0]];
+        for (int v : factor.scope) first = std::min(first, model.position[v]);
+        buckets[first].push_back(std::move(factor));
+    };
+    for (const Factor& factor : initial) place(Factor(factor));
+
+    for (size_t b = 0; b < buckets.size() && result.log_value > NEG_INF; ++b) {
+        if (buckets[b].empty()) continue;
+        if (deadline && Clock::now() > *deadline) {
+            result.timed_out = true;
+            return result;
+        }
+        const int x = model.order[b];
+
+        // First-fit dei fattori (dal piu' grande) in mini-bucket di al massimo i_bound variabili
+        std::vector<Factor>& bucket = buckets[b];
+        std::stable_sort(bucket.begin(), bucket.end(), [](const Factor& lhs, const Factor& rhs) {
+            return lhs.scope.size() > rhs.scope.size();
+        });
+        std::vector<std::vector<const Factor*>> minis;
+        std::vector<std::vector<int>> mini_scopes;
+        for (const Factor& factor : bucket) {
+            std::vector<int> scope = factor.scope;
+            std::sort(scope.begin(), scope.end());
+            bool placed = false;
+            for (size_t m = 0; m < minis.size() && !placed; ++m) {
+                std::vector<int> merged;
+                std::set_union(mini_scopes[m].begin(), mini_scopes[m].end(), scope.begin(), scope.end(), std::back_inserter(merged));
+                if (static_cast<int>(merged.size()) <= i_bound) {
+                    minis[m].push_back(&factor);
+                    mini_scopes[m].swap(merged);
+                    placed = true;
+                }
+            }
+            if (!placed) {
+                minis.push_back(std::vector<const Factor*>(1, &factor));
+                mini_scopes.push_back(scope);
+            }
+        }
+        if (minis.size() > 1) result.split = true;
+
+        std::vector<Factor> messages(minis.size());
+        for (size_t m = 0; m < minis.size(); ++m) {
+            EliminationOp op = EliminationOp::Sum;
+            if (m > 0) {
+                op = mode == BoundMode::Upper ? EliminationOp::Max
+                   : mode == BoundMode::Lower ? EliminationOp::Min : EliminationOp::Mean;
+            }
+            if (!combineEliminate(model, minis[m], x, op, deadline, messages[m])) {
+                result.timed_out = true;
+                return result;
+            }
+        }
+        bucket.clear();
+
+        for (Factor& message : messages) {
+            result.max_table_entries = std::max(result.max_table_entries, static_cast<long long>(message.table.size()));
+            double scale = *std::max_element(message.table.begin(), message.table.end());
+            if (scale <= 0.0) {
+                result.log_value = NEG_INF;
+                break;
+            }
+            for (double& value : message.table) value /= scale;
+            result.log_value += std::log(scale);
+            place(std::move(message));
+        }
+    }
+    return result;
+}
+
+double logSumExp(const std::vector<double>& logs, int skip = -1) {
+    double top = NEG_INF;
+    for (size_t i = 0; i < logs.size(); ++i) {
+        if (static_cast<int>(i) != skip) top = std::max(top, logs[i]);
+    }
+    if (top == NEG_INF) return NEG_INF;
+    double sum = 0.0;
+    for (size_t i = 0; i < logs.size(); ++i) {
+        if (static_cast<int>(i) != skip) sum += std::exp(logs[i] - top);
+    }
+    return top + std::log(sum);
+}
+
+// a / (a + b) dati log a e log b
+double ratio(double log_a, double log_b) {
+    if (log_a == NEG_INF) return 0.0;
+    if (log_b == NEG_INF) return 1.0;
+    return 1.0 / (1.0 + std::exp(log_b - log_a));
+}
+
+// Log bounds of one joint probability P(values)
+struct LogBounds {
+    double upper = 0.0;
+    double lower = NEG_INF;
+    double estimate = NEG_INF;
+};
+
+// Bounds of P(e) and of P(X = x, e) for every query value at one i-bound
+struct BoundsRun {
+    LogBounds evidence;
+    std::vector<std::vector<LogBounds>> joint;  // [query][value]
+    bool exact = true;
+    long long max_table_entries = 0;
+};
+
+bool boundJoint(const Model& model, const std::vector<int>& values, int i_bound,
+                const Clock::time_point* deadline, LogBounds& bounds, BoundsRun& run) {
+    std::vector<Factor> factors(model.variables.size());
+    for (size_t x = 0; x < model.variables.size(); ++x) {
+        if (!familyFactor(model, static_cast<int>(x), values, deadline, factors[x])) return false;
+        run.max_table_entries = std::max(run.max_table_entries, static_cast<long long>(factors[x].table.size()));
+    }
+    EliminationResult upper = eliminate(model, factors, i_bound, BoundMode::Upper, deadline);
+    EliminationResult lower = eliminate(model, factors, i_bound, BoundMode::Lower, deadline);
+    EliminationResult estimate = eliminate(model, factors, i_bound, BoundMode::Estimate, deadline);
+    if (upper.timed_out || lower.timed_out || estimate.timed_out) return false;
+
+    bounds.upper = std::min(upper.log_value, 0.0);
+    bounds.lower = std::min(lower.log_value, bounds.upper);
+    bounds.estimate = std::max(bounds.lower, std::min(estimate.log_value, bounds.upper));
+    run.exact = run.exact && !upper.split;
+    run.max_table_entries = std::max(run.max_table_entries, upper.max_table_entries);
+    return true;
+}
+
+bool runBounds(const Model& model, const std::vector<int>& observed, const std::vector<int>& query_ids,
+               int i_bound, const Clock::time_point* deadline, BoundsRun& run) {
+    if (!boundJoint(model, observed, i_bound, deadline, run.evidence, run)) return false;
+    std::vector<int> values = observed;
+    run.joint.assign(query_ids.size(), std::vector<LogBounds>());
+    for (size_t q = 0; q < query_ids.size(); ++q) {
+        int x = query_ids[q];
+        if (observed[x] >= 0) continue;
+        run.joint[q].resize(model.cardinality[x]);
+        for (int v = 0; v < model.cardinality[x]; ++v) {
+            values[x] = v;
+            if (!boundJoint(model, values, i_bound, deadline, run.joint[q][v], run)) return false;
+        }
+        values[x] = -1;
+    }
+    return true;
+}
+
+// No information at all: P(e) and every P(x, e) in [0, 1], uniform estimates
+BoundsRun trivialRun(const Model& model, const std::vector<int>& observed, const std::vector<int>& query_ids) {
+    BoundsRun run;
+    run.exact = false;
+    LogBounds trivial;
+    trivial.estimate = 0.0;
+    run.evidence = trivial;
+    run.joint.assign(query_ids.size(), std::vector<LogBounds>());
+    for (size_t q = 0; q < query_ids.size(); ++q) {
+        if (observed[query_ids[q]] < 0) run.joint[q].assign(model.cardinality[query_ids[q]], trivial);
+    }
+    return run;
+}
+
+// Keeps the tightest bounds seen so far; the estimate always comes from the latest run
+void mergeBounds(LogBounds& best, const LogBounds& latest) {
+    best.upper = std::min(best.upper, latest.upper);
+    best.lower = std::max(best.lower, latest.lower);
+    best.estimate = latest.estimate;
+}
+
+} // namespace
+
+std::map<std::string, std::map<std::string, ProbabilityBounds>> calculateProbabilitiesWithMiniBuckets(
+    const BayesianNetwork& bn,
+    const Evidence& evidence,
+    const MiniBucketOptions& options,
+    const std::string& query_variable,
+    MiniBucketStats* stats
+) {
+    auto start_time = Clock::now();
+    std::map<std::string, std::map<std::string, ProbabilityBounds>> result;
+    // Le famiglie noisy-OR/MAX diventano catene di CPT con al piu' 3 variabili
+    BayesianNetwork network = decomposeCompactCPTs(bn);
+    std::vector<int> observed = evidenceToValues(bn, evidence);
+    observed.resize(network.next_id, -1);
+    Model model = buildModel(network);
+
+    std::vector<int> query_ids;
+    if (query_variable.empty()) {
+        for (int x = 0; x < bn.next_id; ++x) query_ids.push_back(x);
+    } else if (bn.variables.count(query_variable)) {
+        query_ids.push_back(bn.variables.at(query_variable).id);
+    } else {
+        std::cerr << "Error: unknown query variable " << query_variable << std::endl;
+        return result;
+    }
+
+    // Anytime: si parte dal piu' piccolo i-bound utilizzabile e ogni esecuzione, anche la prima,
+    // viene abbandonata alla scadenza; le successive hanno i-bound + 1
+    const bool anytime = options.time_budget > 0.0;
+    Clock::time_point deadline = start_time + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(options.time_budget));
+    // Un fattore iniziale piu' largo dell'i-bound finirebbe da solo in un mini-bucket e la sua tabella
+    // supererebbe il limite: l'i-bound non scende mai sotto la famiglia piu' grande
+    int i_bound = anytime ? model.largest_family : std::max(model.largest_family, options.i_bound);
+    int runs = 0;
+    int completed_i_bound = 0;
+    BoundsRun best;
+    BoundsRun latest;
+    while (true) {
+        auto run_start = Clock::now();
+        BoundsRun run;
+        if (!runBounds(model, observed, query_ids, i_bound, anytime ? &deadline : nullptr, run)) break;
+        if (runs == 0) {
+            best = run;
+        } else {
+            mergeBounds(best.evidence, run.evidence);
+            for (size_t q = 0; q < run.joint.size(); ++q) {
+                for (size_t v = 0; v < run.joint[q].size(); ++v) mergeBounds(best.joint[q][v], run.joint[q][v]);
+            }
+        }
+        latest = run;
+        completed_i_bound = i_bound;
+        ++runs;
+        if (run.exact || !anytime || i_bound >= static_cast<int>(model.variables.size())) break;
+        // la prossima esecuzione costa almeno quanto questa: non iniziarla se non puo' finire in tempo
+        if (Clock::now() + (Clock::now() - run_start) > deadline) break;
+        ++i_bound;
+    }
+    if (runs == 0) {
+        best = latest = trivialRun(model, observed, query_ids);
+    }
+
+    // P(e) = sum_x P(x, e): every query variable gives another pair of bounds
+    double log_pe_upper = best.evidence.upper;
+    double log_pe_lower = best.evidence.lower;
+    for (size_t q = 0; q < query_ids.size(); ++q) {
+        if (best.joint[q].empty()) continue;
+        std::vector<double> uppers, lowers;
+        for (const LogBounds& b : best.joint[q]) {
+            uppers.push_back(b.upper);
+            lowers.push_back(b.lower);
+        }
+        log_pe_upper = std::min(log_pe_upper, logSumExp(uppers));
+        log_pe_lower = std::max(log_pe_lower, logSumExp(lowers));
+    }
+
+    for (size_t q = 0; q < query_ids.size(); ++q) {
+        const Variable& var = *model.variables[query_ids[q]];
+        std::map<std::string, ProbabilityBounds>& marginal = result[var.name];
+        if (observed[var.id] >= 0) {
+            for (size_t v = 0; v < var.values.size(); ++v) {
+                double p = static_cast<int>(v) == observed[var.id] ? 1.0 : 0.0;
+                ProbabilityBounds bounds;
+                bounds.estimate = bounds.lower = bounds.upper = p;
+                marginal[var.values[v]] = bounds;
+            }
+            continue;
+        }
+
+        std::vector<double> uppers, lowers, estimates;
+        for (size_t v = 0; v < var.values.size(); ++v) {
+            uppers.push_back(best.joint[q][v].upper);
+            lowers.push_back(best.joint[q][v].lower);
+            estimates.push_back(latest.joint[q][v].estimate);
+        }
+        double log_norm = logSumExp(estimates);
+        for (size_t v = 0; v < var.values.size(); ++v) {
+            // P(x | e) = a / (a + b) cresce con a = P(x, e) e decresce con b = P(not x, e)
+            ProbabilityBounds bounds;
+            // e anche P(x, e) / P(e) con i limiti di P(e)
+            bounds.upper = ratio(uppers[v], logSumExp(lowers, static_cast<int>(v)));
+            if (log_pe_lower > NEG_INF) bounds.upper = std::min(bounds.upper, std::exp(uppers[v] - log_pe_lower));
+            bounds.lower = std::max(ratio(lowers[v], logSumExp(uppers, static_cast<int>(v))),
+                                    lowers[v] == NEG_INF ? 0.0 : std::exp(lowers[v] - log_pe_upper));
+            bounds.estimate = log_norm == NEG_INF ? 0.0 : std::exp(estimates[v] - log_norm);
+            bounds.estimate = std::max(bounds.lower, std::min(bounds.estimate, bounds.upper));
+            marginal[var.values[v]] = bounds;
+        }
+    }
+
+    // Evidence variables are always reported, as in the other engines
+    for (int x = 0; x < bn.next_id; ++x) {
+        const Variable& var = *model.variables[x];
+        if (observed[x] < 0 || result.count(var.name)) continue;
+        for (size_t v = 0; v < var.values.size(); ++v) {
+            double p = static_cast<int>(v) == observed[x] ? 1.0 : 0.0;
+            ProbabilityBounds bounds;
+            bounds.estimate = bounds.lower = bounds.upper = p;
+            result[var.name][var.values[v]] = bounds;
+        }
+    }
+
+    if (stats) {
+        stats->i_bound = completed_i_bound;
+        stats->largest_family = model.largest_family;
+        stats->runs = runs;
+        stats->exact = latest.exact;
+        stats->max_table_entries = latest.max_table_entries;
+        stats->seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+        stats->prob_evidence.upper = std::exp(log_pe_upper);
+        stats->prob_evidence.lower = std::exp(log_pe_lower);
+        // senza esecuzioni completate la stima di P(e) non esiste: la corsa banale darebbe 1
+        stats->prob_evidence_known = runs > 0;
+        stats->prob_evidence.estimate = runs > 0
+            ? std::max(stats->prob_evidence.lower, std::min(std::exp(latest.evidence.estimate), stats->prob_evidence.upper))
+            : std::numeric_limits<double>::quiet_NaN();
+    }
+    return result;
+}
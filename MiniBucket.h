@@ -0,0 +1,47 @@
+#ifndef MINI_BUCKET_H
+#define MINI_BUCKET_H
+
+#include "BayesianNetwork.h"
+
+// Estimate of a probability together with guaranteed lower and upper bounds
+struct ProbabilityBounds {
+    double estimate = 0.0;
+    double lower = 0.0;
+    double upper = 1.0;
+};
+
+struct MiniBucketOptions {
+    int i_bound = 10;               // max variables in a mini-bucket, and so in any table; raised to the size
+                                    // of the largest CPT (after decomposeCompactCPTs) when smaller
+    double time_budget = 0.0;       // seconds; > 0 enables the anytime mode: i_bound is ignored, runs start at the
+                                    // smallest usable i-bound and grow by one, every run stops at the deadline
+                                    // (if none completes, all the bounds are [0, 1]); a soft limit: the
+                                    // deadline is checked every few thousand table rows, not preemptively
+};
+
+struct MiniBucketStats {
+    int i_bound = 0;                // i-bound of the last completed run, 0 if none completed
+    int largest_family = 0;         // variables of the largest CPT, the smallest usable i-bound
+    int runs = 0;                   // completed runs (anytime mode)
+    bool exact = false;             // no bucket had to be split: estimate = lower = upper
+    long long max_table_entries = 0;
+    double seconds = 0.0;
+    ProbabilityBounds prob_evidence;
+    bool prob_evidence_known = false; // false if no run completed: prob_evidence.estimate is NaN, the bounds [0, 1]
+};
+
+// Approximate inference by mini-bucket elimination along the min-fill order of decomposeCompactCPTs(bn),
+// so noisy-OR/MAX families enter as chains of factors over at most 3 variables. Every bucket is split
+// into mini-buckets of at most i_bound variables: the first one is summed out, the others are
+// max-eliminated for the upper bound, min-eliminated for the lower bound and averaged for the
+// estimate. Marginals are bounded through P(x | e) = P(x, e) / (P(x, e) + P(not x, e)).
+// In the anytime mode the tightest bounds over all completed runs are kept, the estimate comes
+// from the largest i-bound, and a run that would cross the deadline is abandoned, the first included.
+std::map<std::string, std::map<std::string, ProbabilityBounds>> calculateProbabilitiesWithMiniBuckets(
+    const BayesianNetwork& bn,
+    const Evidence& evidence,
+    const MiniBucketOptions& options,
+    const std::string& query_variable = "",
+    MiniBucketStats* stats = nullptr);
+
+#endif // MINI_BUCKET_H
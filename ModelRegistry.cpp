@@ -0,0 +1,582 @@
+// ModelRegistry.cpp
+#include "ModelRegistry.h"
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Layout of a model file: the header, then every array 8-byte aligned at the offset stored in
+// the header. Integers are stored in native byte order as int (4 bytes) and long long (8 bytes).
+static_assert(sizeof(int) == 4 && sizeof(long long) == 8 && sizeof(double) == 8, "unexpected type sizes for the model file layout");
+
+namespace {
+
+const char MODEL_MAGIC[8] = {'B', 'N', 'M', 'O', 'D', 'E', 'L', '\0'};
+const unsigned int MODEL_FORMAT = 2;  // 2: compact CPTs stored as such (cpt_kind, cpt_index)
+
+struct ModelFileHeader {
+    char magic[8];
+    unsigned int format;
+    int variables;
+    unsigned long long epoch;
+    unsigned long long file_size;
+    long long parent_count;
+    long long cpt_count;
+    long long index_count;
+    long long value_count;
+    long long string_bytes;
+    // section offsets from the start of the file
+    unsigned long long cardinality;
+    unsigned long long posterior_offset;
+    unsigned long long topological_order;
+    unsigned long long parent_begin;
+    unsigned long long parent_ids;
+    unsigned long long parent_strides;
+    unsigned long long cpt_kind;
+    unsigned long long cpt_offset;
+    unsigned long long cpt;
+    unsigned long long index_offset;
+    unsigned long long cpt_index;
+    unsigned long long name_offset;
+    unsigned long long name_length;
+    unsigned long long sorted_handles;
+    unsigned long long value_begin;
+    unsigned long long value_offset;
+    unsigned long long value_length;
+    unsigned long long strings;
+};
+
+// Accoda array allineati a 8 byte e restituisce il loro offset nel file
+class SectionWriter {
+public:
+    explicit SectionWriter(size_t header_size) : buffer_(header_size, '\0') {}
+
+    template <typename T>
+    unsigned long long append(const T* data, size_t count) {
+        buffer_.resize((buffer_.size() + 7) & ~static_cast<size_t>(7), '\0');
+        unsigned long long offset = buffer_.size();
+        if (count > 0) buffer_.append(reinterpret_cast<const char*>(data), count * sizeof(T));
+        return offset;
+    }
+
+    template <typename T>
+    unsigned long long append(const std::vector<T>& data) { return append(data.data(), data.size()); }
+
+    std::string& buffer() { return buffer_; }
+
+private:
+    std::string buffer_;
+};
+
+bool validModelName(const std::string& name) {
+    if (name.empty() || name[0] == '.') return false;
+    return name.find_first_of("/\\:") == std::string::npos;
+}
+
+// Epoch named by <name>.current, 0 if the model was never published
+unsigned long long readCurrentEpoch(const std::string& pointer_path) {
+    std::ifstream in(pointer_path);
+    unsigned long long epoch = 0;
+    if (!(in >> epoch)) return 0;
+    return epoch;
+}
+
+bool replaceFile(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+std::vector<std::string> listDirectory(const std::string& directory) {
+    std::vector<std::string> entries;
+#ifdef _WIN32
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA((directory + "\\*").c_str(), &data);
+    if (find == INVALID_HANDLE_VALUE) return entries;
+    do {
+        entries.push_back(data.cFileName);
+    } while (FindNextFileA(find, &data));
+    FindClose(find);
+#else
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) return entries;
+    while (struct dirent* entry = readdir(dir)) {
+        entries.push_back(entry->d_name);
+    }
+    closedir(dir);
+#endif
+    return entries;
+}
+
+bool endsWith(const std::string& str, const std::string& suffix) {
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// True if the section [offset, offset + count * element) lies inside the file and is aligned
+bool sectionFits(unsigned long long offset, long long count, size_t element, size_t file_size) {
+    if (count < 0 || offset % 8 != 0 || offset > file_size) return false;
+    return static_cast<unsigned long long>(count) <= (file_size - offset) / element;
+}
+
+template <typename T>
+const T* sectionAt(const char* base, unsigned long long offset) {
+    return reinterpret_cast<const T*>(base + offset);
+}
+
+// True if the string [offset, offset + length) lies inside the string pool
+bool stringFits(long long offset, int length, long long string_bytes) {
+    return offset >= 0 && length >= 0 && offset <= string_bytes && length <= string_bytes - offset;
+}
+
+// Parametri di una CPT compatta coerenti con il layout letto da compactProbability
+bool validCompactCPT(CPTKind kind, int card, long long params_size, const long long* index, long long index_size,
+                     const int* parent_cards, int parent_count, long long rows) {
+    switch (kind) {
+        case CPTKind::NoisyOR:
+        case CPTKind::NoisyMAX:
+            // il numero di parametri lo controlla gia' compactProbability (parametri incompleti = errore)
+            return index_size == 0;
+        case CPTKind::Tree: {
+            long long pos = 0;
+            long long rules = 0;
+            while (pos < index_size) {
+                long long context_size = index[pos++];
+                if (context_size < 0 || context_size > (index_size - pos) / 2) return false;
+                for (long long k = 0; k < context_size; ++k) {
+                    long long parent = index[pos + 2 * k];
+                    if (parent < 0 || parent >= parent_count) return false;
+                    if (index[pos + 2 * k + 1] < 0 || index[pos + 2 * k + 1] >= parent_cards[parent]) return false;
+                }
+                pos += 2 * context_size;
+                ++rules;
+            }
+            return params_size == rules * card;
+        }
+        case CPTKind::Sparse: {
+            if (index_size < 1 || index[0] < 0 || index[0] > index_size - 1) return false;
+            const long long row_count = index[0];
+            for (long long k = 1; k <= row_count; ++k) {
+                if (index[k] < 0 || index[k] >= rows || (k > 1 && index[k] <= index[k - 1])) return false;
+            }
+            for (long long k = row_count + 1; k < index_size; ++k) {
+                if (index[k] < 0 || index[k] / card >= rows || (k > row_count + 1 && index[k] < index[k - 1])) return false;
+            }
+            return params_size == card + (index_size - 1 - row_count);
+        }
+        case CPTKind::Dense:
+            break;
+    }
+    return false;
+}
+
+// Controlla ogni indice del file rispetto ai contatori dell'header, prima che un engine lo usi:
+// un file troncato o corrotto viene rifiutato invece di far leggere fuori dalla mappatura
+bool validModelContents(const ModelFileHeader* header, const char* base) {
+    const int n = header->variables;
+    const int* cardinality = sectionAt<int>(base, header->cardinality);
+    const int* posterior_offset = sectionAt<int>(base, header->posterior_offset);
+    const int* topological_order = sectionAt<int>(base, header->topological_order);
+    const int* parent_begin = sectionAt<int>(base, header->parent_begin);
+    const int* parent_ids = sectionAt<int>(base, header->parent_ids);
+    const long long* parent_strides = sectionAt<long long>(base, header->parent_strides);
+    const int* cpt_kind = sectionAt<int>(base, header->cpt_kind);
+    const long long* cpt_offset = sectionAt<long long>(base, header->cpt_offset);
+    const long long* index_offset = sectionAt<long long>(base, header->index_offset);
+    const long long* cpt_index = sectionAt<long long>(base, header->cpt_index);
+    const long long* name_offset = sectionAt<long long>(base, header->name_offset);
+    const int* name_length = sectionAt<int>(base, header->name_length);
+    const int* sorted_handles = sectionAt<int>(base, header->sorted_handles);
+    const int* value_begin = sectionAt<int>(base, header->value_begin);
+    const long long* value_offset = sectionAt<long long>(base, header->value_offset);
+    const int* value_length = sectionAt<int>(base, header->value_length);
+    const char* strings = base + header->strings;
+
+    if (posterior_offset[0] != 0 || parent_begin[0] != 0 || cpt_offset[0] != 0 || index_offset[0] != 0 || value_begin[0] != 0) return false;
+    if (parent_begin[n] != header->parent_count || cpt_offset[n] != header->cpt_count
+        || index_offset[n] != header->index_count || value_begin[n] != header->value_count) return false;
+
+    // posizione di ogni variabile nell'ordine topologico, che deve essere una permutazione
+    std::vector<int> position(n, -1);
+    for (int k = 0; k < n; ++k) {
+        int x = topological_order[k];
+        if (x < 0 || x >= n || position[x] >= 0) return false;
+        position[x] = k;
+    }
+
+    std::vector<int> parent_cards;
+    for (int x = 0; x < n; ++x) {
+        const int card = cardinality[x];
+        if (card <= 0 || static_cast<long long>(posterior_offset[x]) + card != posterior_offset[x + 1]) return false;
+        if (value_begin[x + 1] - static_cast<long long>(value_begin[x]) != card) return false;
+        if (!stringFits(name_offset[x], name_length[x], header->string_bytes)) return false;
+
+        // genitori: indici validi, gia' assegnati nell'ordine topologico, strides coerenti con le cardinalita'
+        if (parent_begin[x + 1] < parent_begin[x]) return false;
+        const int parent_count = parent_begin[x + 1] - parent_begin[x];
+        parent_cards.assign(parent_count, 0);
+        long long rows = 1;
+        for (int k = parent_count - 1; k >= 0; --k) {
+            int parent = parent_ids[parent_begin[x] + k];
+            if (parent < 0 || parent >= n || position[parent] >= position[x]) return false;
+            if (parent_strides[parent_begin[x] + k] != rows) return false;
+            parent_cards[k] = cardinality[parent];
+            if (parent_cards[k] <= 0 || rows > (1LL << 62) / parent_cards[k]) return false;
+            rows *= parent_cards[k];
+        }
+
+        if (cpt_offset[x + 1] < cpt_offset[x] || index_offset[x + 1] < index_offset[x]) return false;
+        const long long params_size = cpt_offset[x + 1] - cpt_offset[x];
+        const long long index_size = index_offset[x + 1] - index_offset[x];
+        const int kind = cpt_kind[x];
+        if (kind == static_cast<int>(CPTKind::Dense)) {
+            if (rows > (1LL << 62) / card || params_size != rows * card || index_size != 0) return false;
+        } else if (kind < static_cast<int>(CPTKind::Dense) || kind > static_cast<int>(CPTKind::Sparse)
+                   || !validCompactCPT(static_cast<CPTKind>(kind), card, params_size, cpt_index + index_offset[x], index_size,
+                                       parent_cards.data(), parent_count, rows)) {
+            return false;
+        }
+    }
+
+    for (long long k = 0; k < header->value_count; ++k) {
+        if (!stringFits(value_offset[k], value_length[k], header->string_bytes)) return false;
+    }
+
+    // indice dei nomi: una permutazione ordinata, come richiesto dalla ricerca binaria di variableHandle
+    std::vector<char> seen(n, 0);
+    for (int k = 0; k < n; ++k) {
+        int x = sorted_handles[k];
+        if (x < 0 || x >= n || seen[x]) return false;
+        seen[x] = 1;
+        if (k > 0) {
+            int prev = sorted_handles[k - 1];
+            std::string lhs(strings + name_offset[prev], name_length[prev]);
+            if (lhs.compare(0, std::string::npos, strings + name_offset[x], name_length[x]) >= 0) return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+const void* mapReadOnly(const std::string& path, size_t& size) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return nullptr;
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+        CloseHandle(file);
+        return nullptr;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping) return nullptr;
+    const void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping); // la vista resta valida fino a UnmapViewOfFile
+    size = static_cast<size_t>(file_size.QuadPart);
+    return data;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return nullptr;
+    }
+    void* data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // la mappatura resta valida fino a munmap
+    if (data == MAP_FAILED) return nullptr;
+    size = static_cast<size_t>(st.st_size);
+    return data;
+#endif
+}
+
+void unmapReadOnly(const void* data, size_t size) {
+#ifdef _WIN32
+    (void)size;
+    UnmapViewOfFile(data);
+#else
+    munmap(const_cast<void*>(data), size);
+#endif
+}
+
+SharedModel::~SharedModel() {
+    if (base_) unmapReadOnly(base_, size_);
+}
+
+int SharedModel::variableHandle(const std::string& variable) const {
+    // Ricerca binaria sui nomi ordinati, direttamente sulla memoria mappata
+    int low = 0;
+    int high = view_.size;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        int handle = sorted_handles_[mid];
+        int cmp = variable.compare(0, std::string::npos, strings_ + name_offset_[handle], name_length_[handle]);
+        if (cmp == 0) return handle;
+        if (cmp < 0) high = mid; else low = mid + 1;
+    }
+    return -1;
+}
+
+int SharedModel::valueHandle(int variable, const std::string& value) const {
+    if (variable < 0 || variable >= view_.size) return -1;
+    for (int k = value_begin_[variable]; k < value_begin_[variable + 1]; ++k) {
+        if (value.compare(0, std::string::npos, strings_ + value_offset_[k], value_length_[k]) == 0) {
+            return k - value_begin_[variable];
+        }
+    }
+    return -1;
+}
+
+std::string SharedModel::variableName(int variable) const {
+    if (variable < 0 || variable >= view_.size) return "";
+    return std::string(strings_ + name_offset_[variable], name_length_[variable]);
+}
+
+std::string SharedModel::valueName(int variable, int value) const {
+    if (variable < 0 || variable >= view_.size || value < 0 || value >= view_.cardinality[variable]) return "";
+    int k = value_begin_[variable] + value;
+    return std::string(strings_ + value_offset_[k], value_length_[k]);
+}
+
+std::shared_ptr<const SharedModel> mapModelFile(const std::string& path, const std::string& name) {
+    size_t size = 0;
+    const void* data = mapReadOnly(path, size);
+    if (!data) return nullptr;
+
+    std::shared_ptr<SharedModel> model(new SharedModel());
+    model->name_ = name;
+    model->base_ = static_cast<const char*>(data);
+    model->size_ = size;
+
+    const ModelFileHeader* header = static_cast<const ModelFileHeader*>(data);
+    const long long n = size >= sizeof(ModelFileHeader) ? header->variables : -1;
+    bool valid = n >= 0
+        && std::memcmp(header->magic, MODEL_MAGIC, sizeof(MODEL_MAGIC)) == 0
+        && header->format == MODEL_FORMAT
+        && header->file_size == size
+        && sectionFits(header->cardinality, n, sizeof(int), size)
+        && sectionFits(header->posterior_offset, n + 1, sizeof(int), size)
+        && sectionFits(header->topological_order, n, sizeof(int), size)
+        && sectionFits(header->parent_begin, n + 1, sizeof(int), size)
+        && sectionFits(header->parent_ids, header->parent_count, sizeof(int), size)
+        && sectionFits(header->parent_strides, header->parent_count, sizeof(long long), size)
+        && sectionFits(header->cpt_kind, n, sizeof(int), size)
+        && sectionFits(header->cpt_offset, n + 1, sizeof(long long), size)
+        && sectionFits(header->cpt, header->cpt_count, sizeof(double), size)
+        && sectionFits(header->index_offset, n + 1, sizeof(long long), size)
+        && sectionFits(header->cpt_index, header->index_count, sizeof(long long), size)
+        && sectionFits(header->name_offset, n, sizeof(long long), size)
+        && sectionFits(header->name_length, n, sizeof(int), size)
+        && sectionFits(header->sorted_handles, n, sizeof(int), size)
+        && sectionFits(header->value_begin, n + 1, sizeof(int), size)
+        && sectionFits(header->value_offset, header->value_count, sizeof(long long), size)
+        && sectionFits(header->value_length, header->value_count, sizeof(int), size)
+        && sectionFits(header->strings, header->string_bytes, 1, size)
+        && validModelContents(header, model->base_);
+    if (!valid) {
+        std::cerr << "Error: " << path << " is not a valid model file" << std::endl;
+        return nullptr; // il distruttore rilascia la mappatura
+    }
+
+    const char* base = model->base_;
+    NetworkView& view = model->view_;
+    view.size = static_cast<int>(n);
+    view.cardinality = reinterpret_cast<const int*>(base + header->cardinality);
+    view.posterior_offset = reinterpret_cast<const int*>(base + header->posterior_offset);
+    view.topological_order = reinterpret_cast<const int*>(base + header->topological_order);
+    view.parent_begin = reinterpret_cast<const int*>(base + header->parent_begin);
+    view.parent_ids = reinterpret_cast<const int*>(base + header->parent_ids);
+    view.parent_strides = reinterpret_cast<const long long*>(base + header->parent_strides);
+    view.cpt_kind = reinterpret_cast<const int*>(base + header->cpt_kind);
+    view.cpt_offset = reinterpret_cast<const long long*>(base + header->cpt_offset);
+    view.cpt = reinterpret_cast<const double*>(base + header->cpt);
+    view.index_offset = reinterpret_cast<const long long*>(base + header->index_offset);
+    view.cpt_index = reinterpret_cast<const long long*>(base + header->cpt_index);
+    model->name_offset_ = reinterpret_cast<const long long*>(base + header->name_offset);
+    model->name_length_ = reinterpret_cast<const int*>(base + header->name_length);
+    model->sorted_handles_ = reinterpret_cast<const int*>(base + header->sorted_handles);
+    model->value_begin_ = reinterpret_cast<const int*>(base + header->value_begin);
+    model->value_offset_ = reinterpret_cast<const long long*>(base + header->value_offset);
+    model->value_length_ = reinterpret_cast<const int*>(base + header->value_length);
+    model->strings_ = base + header->strings;
+    model->epoch_ = header->epoch;
+    return model;
+}
+
+ModelRegistry::ModelRegistry(const std::string& directory) : directory_(directory) {}
+
+std::string ModelRegistry::pathOf(const std::string& name) const {
+    return directory_ + "/" + name;
+}
+
+unsigned long long ModelRegistry::publish(const std::string& name, const BayesianNetwork& bn) {
+    if (!validModelName(name)) {
+        std::cerr << "Error: invalid model name " << name << std::endl;
+        return 0;
+    }
+#ifdef _WIN32
+    _mkdir(directory_.c_str());
+#else
+    mkdir(directory_.c_str(), 0755);
+#endif
+
+    CompiledNetwork net = compileNetwork(bn);
+    const int n = net.size();
+
+    // Tabelle delle stringhe: nomi e valori come (offset, lunghezza) in un unico pool
+    std::string strings;
+    std::vector<long long> name_offset(n), value_offset;
+    std::vector<int> name_length(n), value_length, value_begin(n + 1, 0);
+    for (int x = 0; x < n; ++x) {
+        name_offset[x] = static_cast<long long>(strings.size());
+        name_length[x] = static_cast<int>(net.names[x].size());
+        strings += net.names[x];
+        for (const std::string& value : net.values[x]) {
+            value_offset.push_back(static_cast<long long>(strings.size()));
+            value_length.push_back(static_cast<int>(value.size()));
+            strings += value;
+        }
+        value_begin[x + 1] = static_cast<int>(value_offset.size());
+    }
+    std::vector<int> sorted_handles(n);
+    for (int x = 0; x < n; ++x) sorted_handles[x] = x;
+    std::sort(sorted_handles.begin(), sorted_handles.end(), [&](int lhs, int rhs) { return net.names[lhs] < net.names[rhs]; });
+
+    ModelFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MODEL_MAGIC, sizeof(MODEL_MAGIC));
+    header.format = MODEL_FORMAT;
+    header.variables = n;
+    header.epoch = readCurrentEpoch(pathOf(name) + ".current") + 1;
+    header.parent_count = static_cast<long long>(net.parent_ids.size());
+    header.cpt_count = static_cast<long long>(net.cpt.size());
+    header.index_count = static_cast<long long>(net.cpt_index.size());
+    header.value_count = static_cast<long long>(value_offset.size());
+    header.string_bytes = static_cast<long long>(strings.size());
+
+    SectionWriter writer(sizeof(ModelFileHeader));
+    header.cardinality = writer.append(net.cardinality);
+    header.posterior_offset = writer.append(net.posterior_offset);
+    header.topological_order = writer.append(net.topological_order);
+    header.parent_begin = writer.append(net.parent_begin);
+    header.parent_ids = writer.append(net.parent_ids);
+    header.parent_strides = writer.append(net.parent_strides);
+    header.cpt_kind = writer.append(net.cpt_kind);
+    header.cpt_offset = writer.append(net.cpt_offset);
+    header.cpt = writer.append(net.cpt);
+    header.index_offset = writer.append(net.index_offset);
+    header.cpt_index = writer.append(net.cpt_index);
+    header.name_offset = writer.append(name_offset);
+    header.name_length = writer.append(name_length);
+    header.sorted_handles = writer.append(sorted_handles);
+    header.value_begin = writer.append(value_begin);
+    header.value_offset = writer.append(value_offset);
+    header.value_length = writer.append(value_length);
+    header.strings = writer.append(strings.data(), strings.size());
+    std::string& buffer = writer.buffer();
+    header.file_size = buffer.size();
+    std::memcpy(&buffer[0], &header, sizeof(header));
+
+    // 1. il nuovo file versionato, 2. il puntatore <name>.current sostituito in modo atomico
+    const std::string epoch_str = std::to_string(header.epoch);
+    // Anche il file dell'epoca passa da un temporaneo: se un file con lo stesso nome esiste ed e'
+    // mappato (es. un publish ripetuto dopo un .current perso), riscriverlo sul posto darebbe SIGBUS ai lettori
+    const std::string data_path = pathOf(name) + "." + epoch_str + ".bnm";
+    const std::string data_tmp = data_path + ".tmp";
+    {
+        std::ofstream out(data_tmp, std::ios::binary | std::ios::trunc);
+        if (!out.is_open() || !out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()))) {
+            std::cerr << "Error: Could not write model file " << data_tmp << std::endl;
+            return 0;
+        }
+    }
+    if (!replaceFile(data_tmp, data_path)) {
+        std::cerr << "Error: Could not write model file " << data_path << std::endl;
+        std::remove(data_tmp.c_str());
+        return 0;
+    }
+    const std::string pointer_tmp = pathOf(name) + ".current.tmp";
+    {
+        std::ofstream out(pointer_tmp, std::ios::trunc);
+        out << epoch_str << "\n";
+        if (!out) {
+            std::cerr << "Error: Could not write " << pointer_tmp << std::endl;
+            return 0;
+        }
+    }
+    if (!replaceFile(pointer_tmp, pathOf(name) + ".current")) {
+        std::cerr << "Error: Could not publish epoch " << epoch_str << " of model " << name << std::endl;
+        return 0;
+    }
+
+    // Le versioni piu' vecchie della precedente non servono piu' a nuovi attach: chi le ha gia'
+    // mappate le conserva (POSIX), mentre dove non si puo' cancellare un file mappato si riprova al prossimo publish
+    const std::string prefix = name + ".";
+    for (const std::string& entry : listDirectory(directory_)) {
+        if (entry.compare(0, prefix.size(), prefix) != 0 || !endsWith(entry, ".bnm")) continue;
+        std::string middle = entry.substr(prefix.size(), entry.size() - prefix.size() - 4);
+        if (middle.empty() || middle.find_first_not_of("0123456789") != std::string::npos) continue;
+        if (std::stoull(middle) + 1 < header.epoch) {
+            std::remove((directory_ + "/" + entry).c_str());
+        }
+    }
+    return header.epoch;
+}
+
+std::shared_ptr<const SharedModel> ModelRegistry::attach(const std::string& name) {
+    if (!validModelName(name)) {
+        std::cerr << "Error: invalid model name " << name << std::endl;
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Un publish concorrente puo' cancellare l'epoca appena letta: in quel caso si rilegge il puntatore
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        unsigned long long epoch = readCurrentEpoch(pathOf(name) + ".current");
+        if (epoch == 0) {
+            std::cerr << "Error: model " << name << " is not published in " << directory_ << std::endl;
+            return nullptr;
+        }
+        auto it = attached_.find(name);
+        if (it != attached_.end() && it->second->epoch() == epoch) {
+            return it->second;
+        }
+        std::shared_ptr<const SharedModel> model = mapModelFile(pathOf(name) + "." + std::to_string(epoch) + ".bnm", name);
+        if (model) {
+            attached_[name] = model;
+            return model;
+        }
+        if (readCurrentEpoch(pathOf(name) + ".current") == epoch) break; // file invalido, non una corsa con publish
+    }
+    std::cerr << "Error: could not map model " << name << std::endl;
+    return nullptr;
+}
+
+bool ModelRegistry::isStale(const SharedModel& model) const {
+    return readCurrentEpoch(pathOf(model.name()) + ".current") != model.epoch();
+}
+
+std::vector<std::string> ModelRegistry::list() const {
+    std::vector<std::string> names;
+    for (const std::string& entry : listDirectory(directory_)) {
+        if (endsWith(entry, ".current") && entry[0] != '.') {
+            names.push_back(entry.substr(0, entry.size() - 8));
+        }
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
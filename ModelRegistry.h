@@ -0,0 +1,83 @@
+#ifndef MODEL_REGISTRY_H
+#define MODEL_REGISTRY_H
+
+#include "CompiledNetwork.h"
+#include <memory>
+#include <mutex>
+
+// A compiled network mapped read-only from the registry. The file contains only offsets, never
+// pointers, so every process maps the same physical pages wherever they land in its address space.
+// The mapping lives as long as the last shared_ptr to it, even if a newer epoch replaced the file.
+class SharedModel {
+public:
+    ~SharedModel();
+
+    const std::string& name() const { return name_; }
+    unsigned long long epoch() const { return epoch_; }
+    const NetworkView& view() const { return view_; }
+    size_t bytes() const { return size_; }
+
+    // Name resolution on the mapped string tables; -1 if unknown
+    int variableHandle(const std::string& variable) const;
+    int valueHandle(int variable, const std::string& value) const;
+    std::string variableName(int variable) const;
+    std::string valueName(int variable, int value) const;
+
+private:
+    friend std::shared_ptr<const SharedModel> mapModelFile(const std::string& path, const std::string& name);
+    SharedModel() {}
+
+    std::string name_;
+    unsigned long long epoch_ = 0;
+    const char* base_ = nullptr;
+    size_t size_ = 0;
+    NetworkView view_;
+    const long long* name_offset_ = nullptr;  // per variable, into the string pool
+    const int* name_length_ = nullptr;
+    const int* sorted_handles_ = nullptr;     // variable handles sorted by name
+    const int* value_begin_ = nullptr;        // values of X: value_offset_[value_begin_[X] .. value_begin_[X + 1])
+    const long long* value_offset_ = nullptr;
+    const int* value_length_ = nullptr;
+    const char* strings_ = nullptr;
+};
+
+// Maps a whole file read-only (model files, and the data file of Learning); nullptr if missing or empty.
+// The mapping stays valid until unmapReadOnly, even if the file is renamed or deleted.
+const void* mapReadOnly(const std::string& path, size_t& size);
+void unmapReadOnly(const void* data, size_t size);
+
+// Maps one model file (normally through ModelRegistry). Returns nullptr if the file is missing or invalid:
+// every index stored in the file is range-checked against the counts in its header before it is accepted.
+std::shared_ptr<const SharedModel> mapModelFile(const std::string& path, const std::string& name);
+
+// Directory of published models, one <name>.bnm file each. Put it on a tmpfs such as /dev/shm
+// to keep the models in shared memory; any directory works as an mmap'd file store.
+//
+// Publishing writes the epoch file and the pointer file through temporaries renamed into place, so it is atomic for readers and
+// bumps the epoch of the model. attach() notices the new file and maps it, while workers still
+// holding the previous SharedModel keep a valid mapping until they release it (hot swap).
+class ModelRegistry {
+public:
+    explicit ModelRegistry(const std::string& directory);
+
+    // Compiles bn and publishes it under name. Returns the new epoch, 0 on error.
+    unsigned long long publish(const std::string& name, const BayesianNetwork& bn);
+
+    // Current version of the model, mapped at most once per process and epoch; nullptr if not published
+    std::shared_ptr<const SharedModel> attach(const std::string& name);
+
+    // True if a newer epoch of the model has been published since it was attached
+    bool isStale(const SharedModel& model) const;
+
+    // Names of the published models, sorted
+    std::vector<std::string> list() const;
+
+private:
+    std::string directory_;
+    std::mutex mutex_;
+    std::map<std::string, std::shared_ptr<const SharedModel>> attached_;
+
+    std::string pathOf(const std::string& name) const;
+};
+
+#endif // MODEL_REGISTRY_H
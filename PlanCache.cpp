@@ -0,0 +1,314 @@
+// PlanCache.cpp
+#include "PlanCache.h"
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <chrono>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+std::mutex plan_mutex;
+std::string plan_directory;
+std::map<std::string, EliminationPlan> plan_memory;  // by structure hash
+
+// Pausa di PlanImprover tra due restart
+const std::chrono::milliseconds MIN_PAUSE(1);
+const std::chrono::milliseconds MAX_PAUSE(100);
+
+const unsigned long long FNV_OFFSET = 14695981039346656037ULL;
+const unsigned long long FNV_PRIME = 1099511628211ULL;
+
+void hashString(unsigned long long& hash, const std::string& str) {
+    for (unsigned char c : str) {
+        hash ^= c;
+        hash *= FNV_PRIME;
+    }
+    hash ^= 0xff; // separatore, cosi' "ab","c" e "a","bc" non collidono
+    hash *= FNV_PRIME;
+}
+
+std::string planPath(const std::string& hash) {
+    return plan_directory + "/" + hash + ".plan";
+}
+
+// Formato testuale:
+//   plan <hash>
+//   width <w>
+//   cost <c>
+//   restarts <r>
+//   order <n> <nome>...
+//   cliques <m>
+//   <k> <nome>...       (una riga per cricca)
+bool writePlanFile(const std::string& path, const EliminationPlan& plan) {
+    const std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::trunc);
+        if (!out.is_open()) {
+            std::cerr << "Error: Could not create file " << tmp_path << std::endl;
+            return false;
+        }
+        out.precision(17);
+        out << "plan " << plan.structure_hash << "\n";
+        out << "width " << plan.width << "\n";
+        out << "cost " << plan.cost << "\n";
+        out << "restarts " << plan.restarts << "\n";
+        out << "order " << plan.order.size();
+        for (const std::string& name : plan.order) out << " " << name;
+        out << "\n";
+        out << "cliques " << plan.cliques.size() << "\n";
+        for (const auto& clique : plan.cliques) {
+            out << clique.size();
+            for (const std::string& name : clique) out << " " << name;
+            out << "\n";
+        }
+        if (!out) {
+            std::cerr << "Error: Could not write file " << tmp_path << std::endl;
+            return false;
+        }
+    }
+    // rename sostituisce il file in modo atomico; dove non puo' sovrascrivere (Windows) si rimuove prima
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::remove(path.c_str());
+        if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+            std::cerr << "Error: Could not replace " << path << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Reads a plan and checks that it is a complete order of the variables of bn
+bool readPlanFile(const std::string& path, const BayesianNetwork& bn, const std::string& hash, EliminationPlan& plan) {
+    std::ifstream in(path);
+    if (!in.is_open()) return false;
+
+    std::string keyword;
+    size_t count = 0;
+    bool ok = static_cast<bool>(in >> keyword >> plan.structure_hash) && keyword == "plan" && plan.structure_hash == hash;
+    ok = ok && (in >> keyword >> plan.width) && keyword == "width";
+    ok = ok && (in >> keyword >> plan.cost) && keyword == "cost";
+    ok = ok && (in >> keyword >> plan.restarts) && keyword == "restarts";
+    ok = ok && (in >> keyword >> count) && keyword == "order" && count == static_cast<size_t>(bn.next_id);
+    plan.order.clear();
+    std::set<std::string> seen;
+    for (size_t i = 0; ok && i < count; ++i) {
+        std::string name;
+        ok = (in >> name) && bn.variables.count(name) && seen.insert(name).second;
+        plan.order.push_back(name);
+    }
+    ok = ok && (in >> keyword >> count) && keyword == "cliques";
+    plan.cliques.clear();
+    for (size_t c = 0; ok && c < count; ++c) {
+        size_t size = 0;
+        ok = static_cast<bool>(in >> size);
+        std::vector<std::string> clique(size);
+        for (size_t i = 0; ok && i < size; ++i) {
+            ok = (in >> clique[i]) && bn.variables.count(clique[i]);
+        }
+        plan.cliques.push_back(clique);
+    }
+    if (!ok) {
+        std::cerr << "Warning: ignoring invalid plan file " << path << std::endl;
+    }
+    return ok;
+}
+
+// Meno celle in totale, a parita' di costo la larghezza minore
+bool cheaperPlan(const EliminationPlan& lhs, const EliminationPlan& rhs) {
+    return lhs.cost < rhs.cost || (lhs.cost == rhs.cost && lhs.width < rhs.width);
+}
+
+} // namespace
+
+std::string structureHash(const BayesianNetwork& bn) {
+    unsigned long long hash = FNV_OFFSET;
+    for (const auto& pair : bn.variables) { // std::map: in ordine di nome, indipendente dagli ID
+        const Variable& var = pair.second;
+        hashString(hash, var.name);
+        hashString(hash, std::to_string(var.values.size()));
+        std::vector<std::string> parents = var.parents;
+        std::sort(parents.begin(), parents.end());
+        for (const std::string& parent : parents) hashString(hash, parent);
+        hashString(hash, "|");
+    }
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", hash);
+    return hex;
+}
+
+EliminationPlan evaluateEliminationOrder(const BayesianNetwork& bn, const std::vector<int>& order) {
+    EliminationPlan plan;
+    plan.structure_hash = structureHash(bn);
+    std::vector<std::set<int>> neighbours = moral_graph(bn);
+    std::vector<double> cardinality(bn.next_id, 1.0);
+    for (const auto& pair : bn.variables) {
+        cardinality[pair.second.id] = static_cast<double>(pair.second.values.size());
+    }
+
+    std::vector<std::vector<int>> cliques;
+    for (int x : order) {
+        std::vector<int> clique(neighbours[x].begin(), neighbours[x].end());
+        clique.push_back(x);
+        std::sort(clique.begin(), clique.end());
+        double entries = 1.0;
+        for (int v : clique) entries *= cardinality[v];
+        plan.cost += entries;
+        plan.width = std::max(plan.width, static_cast<int>(clique.size()) - 1);
+
+        // Una cricca di eliminazione non e' massimale solo se contenuta in una precedente
+        bool maximal = true;
+        for (const std::vector<int>& previous : cliques) {
+            if (std::includes(previous.begin(), previous.end(), clique.begin(), clique.end())) {
+                maximal = false;
+                break;
+            }
+        }
+        if (maximal) cliques.push_back(clique);
+
+        for (int a : neighbours[x]) {
+            for (int b : neighbours[x]) {
+                if (a != b) neighbours[a].insert(b);
+            }
+            neighbours[a].erase(x);
+        }
+        neighbours[x].clear();
+        plan.order.push_back(bn.id_to_name.at(x));
+    }
+
+    for (const std::vector<int>& clique : cliques) {
+        std::vector<std::string> names;
+        for (int v : clique) names.push_back(bn.id_to_name.at(v));
+        plan.cliques.push_back(names);
+    }
+    return plan;
+}
+
+std::vector<int> randomized_min_fill_elimination_order(const BayesianNetwork& bn, unsigned long long seed) {
+    std::mt19937_64 rng(seed);
+    return min_fill_elimination_order(bn, &rng);
+}
+
+void setPlanCacheDirectory(const std::string& directory) {
+    std::lock_guard<std::mutex> lock(plan_mutex);
+    plan_directory = directory;
+    if (!plan_directory.empty()) {
+        // Come ModelRegistry::publish: la directory viene creata se manca (un errore emerge alla prima scrittura)
+#ifdef _WIN32
+        _mkdir(plan_directory.c_str());
+#else
+        mkdir(plan_directory.c_str(), 0755);
+#endif
+    }
+}
+
+EliminationPlan getEliminationPlan(const BayesianNetwork& bn, bool* loaded) {
+    const std::string hash = structureHash(bn);
+    if (loaded) *loaded = false;
+    std::lock_guard<std::mutex> lock(plan_mutex);
+
+    auto it = plan_memory.find(hash);
+    if (it != plan_memory.end()) {
+        return it->second;
+    }
+    EliminationPlan plan;
+    if (!plan_directory.empty() && readPlanFile(planPath(hash), bn, hash, plan)) {
+        if (loaded) *loaded = true;
+        plan_memory[hash] = plan;
+        return plan;
+    }
+
+    plan = evaluateEliminationOrder(bn, min_fill_elimination_order(bn));
+    plan_memory[hash] = plan;
+    if (!plan_directory.empty()) {
+        writePlanFile(planPath(hash), plan);
+    }
+    return plan;
+}
+
+bool offerEliminationPlan(const BayesianNetwork& bn, const EliminationPlan& plan) {
+    std::lock_guard<std::mutex> lock(plan_mutex);
+    auto it = plan_memory.find(plan.structure_hash);
+    if (it != plan_memory.end() && !cheaperPlan(plan, it->second)) {
+        return false;
+    }
+    // Un altro processo puo' aver salvato nel frattempo un piano migliore
+    EliminationPlan stored;
+    if (!plan_directory.empty() && readPlanFile(planPath(plan.structure_hash), bn, plan.structure_hash, stored)
+        && !cheaperPlan(plan, stored)) {
+        plan_memory[plan.structure_hash] = stored;
+        return false;
+    }
+    plan_memory[plan.structure_hash] = plan;
+    if (!plan_directory.empty()) {
+        writePlanFile(planPath(plan.structure_hash), plan);
+    }
+    return true;
+}
+
+std::vector<int> planned_elimination_order(const BayesianNetwork& bn) {
+    EliminationPlan plan = getEliminationPlan(bn);
+    std::vector<int> order;
+    for (const std::string& name : plan.order) {
+        order.push_back(bn.name_to_id.at(name));
+    }
+    return order;
+}
+
+PlanImprover::PlanImprover(const BayesianNetwork& bn, unsigned long long seed)
+    : bn_(bn), seed_(seed), stop_(false), restarts_(0), improvements_(0) {}
+
+PlanImprover::~PlanImprover() {
+    stop();
+}
+
+void PlanImprover::start() {
+    if (thread_.joinable()) return;
+    stop_ = false;
+    thread_ = std::thread(&PlanImprover::run, this);
+}
+
+void PlanImprover::stop() {
+    {
+        std::lock_guard<std::mutex> lock(pause_mutex_);
+        stop_ = true;
+    }
+    stopped_.notify_all();
+    if (thread_.joinable()) thread_.join();
+}
+
+void PlanImprover::run() {
+    EliminationPlan best = getEliminationPlan(bn_);
+    const long long base_restarts = best.restarts;
+    std::mt19937_64 seeds(seed_);
+    std::chrono::milliseconds backoff = MIN_PAUSE;
+    while (!stop_) {
+        auto restart_start = std::chrono::steady_clock::now();
+        EliminationPlan plan = evaluateEliminationOrder(bn_, randomized_min_fill_elimination_order(bn_, seeds()));
+        ++restarts_;
+        backoff = std::min(backoff * 2, MAX_PAUSE);
+        if (cheaperPlan(plan, best)) {
+            plan.restarts = base_restarts + restarts_;
+            if (offerEliminationPlan(bn_, plan)) {
+                ++improvements_;
+                best = plan;
+                backoff = MIN_PAUSE;
+            } else {
+                best = getEliminationPlan(bn_); // un altro thread o processo ha gia' trovato di meglio
+            }
+        }
+        // Pausa lunga almeno quanto il restart (al piu' mezzo core) e che raddoppia a ogni restart senza
+        // miglioramenti fino a MAX_PAUSE: una ricerca ormai ferma lascia la CPU alle query.
+        // stop() interrompe la pausa.
+        auto pause = std::max(backoff, std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - restart_start));
+        std::unique_lock<std::mutex> lock(pause_mutex_);
+        stopped_.wait_for(lock, pause, [this] { return stop_.load(); });
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef PLAN_CACHE_H
+#define PLAN_CACHE_H
+
+#include "BayesianNetwork.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Elimination order of a network with the cliques it induces on the moral graph. Variables are
+// stored by name, so a plan stays valid whatever IDs a later parse (or reordering) assigns.
+struct EliminationPlan {
+    std::string structure_hash;
+    std::vector<std::string> order;
+    std::vector<std::vector<std::string>> cliques;  // maximal elimination cliques
+    int width = 0;                                   // largest clique size - 1
+    double cost = 0.0;                               // sum of the table sizes of all elimination cliques
+    long long restarts = 0;                          // randomized min-fill restarts that led to this plan
+};
+
+// 64-bit FNV-1a hash (16 hex digits) of the variables, their cardinalities and their parent sets,
+// independent of the IDs and of the declaration order
+std::string structureHash(const BayesianNetwork& bn);
+
+// Plan of an elimination order given as variable IDs
+EliminationPlan evaluateEliminationOrder(const BayesianNetwork& bn, const std::vector<int>& order);
+
+// Min-fill with the ties broken at random instead of by family size
+std::vector<int> randomized_min_fill_elimination_order(const BayesianNetwork& bn, unsigned long long seed);
+
+// Directory of persisted plans, one <structure hash>.plan file per network ("" = memory only, the default).
+// It is created if missing.
+void setPlanCacheDirectory(const std::string& directory);
+
+// Best known plan for the structure of bn: from memory, then from the cache directory, otherwise
+// computed with min-fill and stored. loaded (optional) tells whether it came from disk.
+EliminationPlan getEliminationPlan(const BayesianNetwork& bn, bool* loaded = nullptr);
+
+// Stores plan (of the structure of bn) if it is cheaper than the known one, in memory or on disk,
+// comparing the cost and then the width; returns true if it was stored
+bool offerEliminationPlan(const BayesianNetwork& bn, const EliminationPlan& plan);
+
+// Elimination order of the cached plan as IDs of bn: used by the engines instead of recomputing min-fill
+std::vector<int> planned_elimination_order(const BayesianNetwork& bn);
+
+// Background search for a better plan: randomized min-fill restarts on a thread that pauses after
+// each of them, every improvement is stored at once. The pause is at least as long as the restart
+// (so the search takes at most half a core) and doubles after every restart that finds nothing,
+// from 1 ms up to 100 ms; an improvement resets it.
+// Meant for idle time; stop() (or the destructor) ends it without waiting for the pause.
+class PlanImprover {
+public:
+    explicit PlanImprover(const BayesianNetwork& bn, unsigned long long seed = 1);
+    ~PlanImprover();
+
+    void start();
+    void stop();
+
+    long long restarts() const { return restarts_; }
+    long long improvements() const { return improvements_; }
+
+private:
+    BayesianNetwork bn_;  // own copy: the search may outlive the caller's network
+    unsigned long long seed_;
+    std::thread thread_;
+    std::atomic<bool> stop_;
+    std::atomic<long long> restarts_;
+    std::atomic<long long> improvements_;
+    std::mutex pause_mutex_;
+    std::condition_variable stopped_;
+
+    void run();
+};
+
+#endif // PLAN_CACHE_H
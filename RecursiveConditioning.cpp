@@ -0,0 +1,567 @@
+// RecursiveConditioning.cpp
+#include "RecursiveConditioning.h"
+#include "PlanCache.h"
+#include <iostream>
+#include <algorithm>
+#include <iterator>
+#include <functional>
+
+namespace {
+
+// Nodo del dtree: le foglie contengono la CPT di una variabile, i nodi interni
+// separano le CPT in due sottoalberi che diventano indipendenti una volta istanziato il cutset.
+struct DtreeNode {
+    int left = -1;
+    int right = -1;
+    int family = -1;                 // leaf: ID of the variable whose CPT is stored here
+    std::vector<int> vars;           // sorted IDs of the variables mentioned in the subtree
+    std::vector<int> cutset;         // variables instantiated by this node
+    std::vector<int> context;        // variables of the subtree already instantiated by the ancestors
+    std::vector<long long> context_strides;
+    double calls = 1.0;              // estimated calls to this node without any caching
+    double work = 1.0;               // estimated cost of one uncached evaluation of the subtree
+    double cache_entries = 1.0;      // product of the cardinalities of the context
+    std::vector<double> cache;       // empty when not cached, -1 marks an entry not yet computed
+    std::vector<double> derivative;  // d P(e) / d cache entry, filled by the downward pass (cached nodes only)
+};
+
+std::vector<int> setUnion(const std::vector<int>& a, const std::vector<int>& b) {
+    std::vector<int> result;
+    std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
+    return result;
+}
+
+std::vector<int> setIntersection(const std::vector<int>& a, const std::vector<int>& b) {
+    std::vector<int> result;
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
+    return result;
+}
+
+std::vector<int> setDifference(const std::vector<int>& a, const std::vector<int>& b) {
+    std::vector<int> result;
+    std::set_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
+    return result;
+}
+
+} // namespace
+
+struct RecursiveConditioner {
+    const BayesianNetwork& bn;
+    std::vector<const Variable*> variables;          // by ID
+    std::vector<int> cardinality;                    // by ID
+    std::vector<std::vector<int>> parent_ids;        // by ID, in the order of Variable::parents
+    std::vector<std::vector<int>> parent_cards;
+    std::vector<std::vector<int>> parent_values;     // scratch buffer for CPT lookups
+    std::vector<DtreeNode> nodes;
+    int root = -1;
+
+    std::vector<int> assignment;                     // current value of each variable, -1 if free
+    std::vector<int> fixed;                          // observed value of each variable, -1 if free
+    std::vector<std::vector<int>> nodes_with_var;    // by ID: internal nodes whose subtree mentions it
+    std::vector<int> cached_nodes;                   // top-down (decreasing index: children precede parents)
+    std::vector<std::vector<double>> joint;          // by ID: P(X = x, e) after differentiate()
+    std::vector<char> family_wanted;                 // by ID: fill family_joint too
+    std::vector<std::vector<double>> family_joint;   // by ID: P(family = (u, x), e) at row(u) * card + x
+    long long cache_budget = 0;
+    bool annotated = false;
+    long long calls = 0;
+
+    RecursiveConditioner(const BayesianNetwork& network, const std::vector<int>& observed, long long cache_budget_bytes,
+                         RecursiveConditioningStats* stats);
+
+    // Sets the evidence: a new set of observed variables re-annotates the dtree (observed variables
+    // leave every cutset and context) and reallocates the caches; new values of the same variables
+    // only invalidate the caches of the subtrees that mention them, every other entry is kept.
+    void setEvidence(const std::vector<int>& observed, RecursiveConditioningStats* stats = nullptr);
+
+    // P(e) for the current evidence
+    double probabilityOfEvidence();
+
+    // P(e) and, in joint, P(X = x, e) for every variable: one upward pass and one downward pass.
+    // families (optional): IDs whose family joint P(u, x, e) is also wanted, in family_joint
+    double differentiate(const std::vector<int>* families = nullptr);
+
+private:
+    void buildDtree(const std::vector<int>& order);
+    void annotate(int t, const std::vector<int>& acutset, double calls_here, const std::vector<int>& observed);
+    void allocateCaches(long long cache_budget_bytes, RecursiveConditioningStats* stats);
+    double rc(int t);
+    double sumOverCutset(const DtreeNode& node, size_t k);
+    double evaluateLeaf(const DtreeNode& node, size_t k);
+    void propagate(int t, double d);
+    void propagateOverCutset(const DtreeNode& node, size_t k, double d);
+    void differentiateLeaf(const DtreeNode& node, size_t k, double d);
+};
+
+RecursiveConditioner::RecursiveConditioner(const BayesianNetwork& network, const std::vector<int>& observed_values,
+                                           long long cache_budget_bytes, RecursiveConditioningStats* stats)
+    : bn(network) {
+    const int n = bn.next_id;
+    std::vector<int> observed = observed_values;
+    observed.resize(n, -1); // le variabili ausiliarie di decomposeCompactCPTs non sono mai osservate
+    variables.resize(n, nullptr);
+    cardinality.resize(n, 0);
+    parent_ids.resize(n);
+    parent_cards.resize(n);
+    parent_values.resize(n);
+    for (const auto& pair : bn.variables) {
+        const Variable& var = pair.second;
+        variables[var.id] = &var;
+        cardinality[var.id] = static_cast<int>(var.values.size());
+    }
+    for (int v = 0; v < n; ++v) {
+        for (const std::string& parent_name : variables[v]->parents) {
+            int parent_id = bn.name_to_id.at(parent_name);
+            parent_ids[v].push_back(parent_id);
+            parent_cards[v].push_back(cardinality[parent_id]);
+        }
+        parent_values[v].resize(parent_ids[v].size());
+    }
+
+    buildDtree(planned_elimination_order(bn));
+    nodes_with_var.resize(n);
+    for (size_t t = 0; t < nodes.size(); ++t) {
+        if (nodes[t].family >= 0) continue;
+        for (int v : nodes[t].vars) nodes_with_var[v].push_back(static_cast<int>(t));
+    }
+    joint.resize(n);
+    for (int v = 0; v < n; ++v) joint[v].resize(cardinality[v]);
+
+    cache_budget = cache_budget_bytes;
+    assignment.assign(n, -1);
+    fixed.assign(n, -1);
+    setEvidence(observed, stats);
+}
+
+// Costruzione del dtree a partire dall'ordine di eliminazione: eliminare X equivale a
+// unire in un unico sottoalbero tutti gli alberi che menzionano X.
+void RecursiveConditioner::buildDtree(const std::vector<int>& order) {
+    std::vector<int> forest;
+    for (int v = 0; v < static_cast<int>(variables.size()); ++v) {
+        DtreeNode leaf;
+        leaf.family = v;
+        leaf.vars = parent_ids[v];
+        leaf.vars.push_back(v);
+        std::sort(leaf.vars.begin(), leaf.vars.end());
+        leaf.vars.erase(std::unique(leaf.vars.begin(), leaf.vars.end()), leaf.vars.end());
+        nodes.push_back(leaf);
+        forest.push_back(static_cast<int>(nodes.size()) - 1);
+    }
+
+    auto compose = [this](int a, int b) {
+        DtreeNode node;
+        node.left = a;
+        node.right = b;
+        node.vars = setUnion(nodes[a].vars, nodes[b].vars);
+        nodes.push_back(node);
+        return static_cast<int>(nodes.size()) - 1;
+    };
+
+    for (int x : order) {
+        std::vector<int> containing;
+        std::vector<int> remaining;
+        for (int t : forest) {
+            if (std::binary_search(nodes[t].vars.begin(), nodes[t].vars.end(), x)) {
+                containing.push_back(t);
+            } else {
+                remaining.push_back(t);
+            }
+        }
+        if (containing.empty()) continue;
+
+        int tree = containing[0];
+        for (size_t i = 1; i < containing.size(); ++i) {
+            tree = compose(tree, containing[i]);
+        }
+        remaining.push_back(tree);
+        forest = remaining;
+    }
+
+    // Componenti disconnesse: uniscile in un solo albero
+    if (!forest.empty()) {
+        root = forest[0];
+        for (size_t i = 1; i < forest.size(); ++i) {
+            root = compose(root, forest[i]);
+        }
+    }
+}
+
+// Calcola cutset e contesto di ogni nodo. Le variabili osservate sono sempre istanziate,
+// quindi non entrano mai nei cutset ne' nei contesti.
+void RecursiveConditioner::annotate(int t, const std::vector<int>& acutset, double calls_here, const std::vector<int>& observed) {
+    DtreeNode& node = nodes[t];
+    node.calls = calls_here;
+    node.context = setIntersection(node.vars, acutset);
+
+    node.cache_entries = 1.0;
+    node.context_strides.assign(node.context.size(), 0);
+    long long stride = 1;
+    for (size_t i = node.context.size(); i-- > 0;) {
+        node.context_strides[i] = stride;
+        stride *= cardinality[node.context[i]];
+        node.cache_entries *= cardinality[node.context[i]];
+    }
+
+    if (node.family >= 0) {
+        node.work = 1.0;
+        return;
+    }
+
+    std::vector<int> shared = setIntersection(nodes[node.left].vars, nodes[node.right].vars);
+    node.cutset.clear();
+    for (int v : setDifference(shared, acutset)) {
+        if (observed[v] < 0) node.cutset.push_back(v);
+    }
+
+    double instantiations = 1.0;
+    for (int v : node.cutset) instantiations *= cardinality[v];
+
+    std::vector<int> child_acutset = setUnion(acutset, node.cutset);
+    int left = node.left;
+    int right = node.right;
+    annotate(left, child_acutset, calls_here * instantiations, observed);
+    annotate(right, child_acutset, calls_here * instantiations, observed);
+    nodes[t].work = instantiations * (nodes[left].work + nodes[right].work);
+}
+
+// Sceglie quali nodi cachare: ordina i nodi interni per beneficio stimato (chiamate risparmiate
+// per il costo di ciascuna) diviso la memoria richiesta, e li prende finche' c'e' budget.
+// Con budget 0 non si cacha nulla e l'algoritmo usa spazio lineare.
+void RecursiveConditioner::allocateCaches(long long cache_budget_bytes, RecursiveConditioningStats* stats) {
+    // Ogni nodo cachato ha due tabelle grandi come il suo contesto: valori e derivate
+    const double bytes_per_entry = 2.0 * sizeof(double);
+    std::vector<std::pair<double, int>> candidates;
+    double full_cache_bytes = 0.0;
+    cached_nodes.clear();
+    for (size_t t = 0; t < nodes.size(); ++t) {
+        DtreeNode& node = nodes[t];
+        std::vector<double>().swap(node.cache);
+        std::vector<double>().swap(node.derivative);
+        if (node.family >= 0 || static_cast<int>(t) == root) continue;
+        double bytes = node.cache_entries * bytes_per_entry;
+        full_cache_bytes += bytes;
+        double saved_calls = node.calls - node.cache_entries;
+        if (saved_calls <= 0.0) continue; // ogni contesto viene visto una sola volta
+        candidates.push_back(std::make_pair(saved_calls * node.work / bytes, static_cast<int>(t)));
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const std::pair<double, int>& a, const std::pair<double, int>& b) {
+        return a.first > b.first;
+    });
+
+    long long remaining = cache_budget_bytes;
+    long long used = 0;
+    int cached = 0;
+    for (const auto& candidate : candidates) {
+        DtreeNode& node = nodes[candidate.second];
+        double bytes = node.cache_entries * bytes_per_entry;
+        if (bytes > static_cast<double>(remaining)) continue;
+        node.cache.assign(static_cast<size_t>(node.cache_entries), -1.0);
+        node.derivative.assign(static_cast<size_t>(node.cache_entries), 0.0);
+        cached_nodes.push_back(candidate.second);
+        remaining -= static_cast<long long>(bytes);
+        used += static_cast<long long>(bytes);
+        ++cached;
+    }
+    std::sort(cached_nodes.begin(), cached_nodes.end(), std::greater<int>());
+
+    if (stats) {
+        stats->dtree_nodes = static_cast<int>(nodes.size());
+        stats->cached_nodes = cached;
+        stats->cache_bytes = used;
+        stats->full_cache_bytes = static_cast<long long>(full_cache_bytes);
+    }
+}
+
+void RecursiveConditioner::setEvidence(const std::vector<int>& observed_values, RecursiveConditioningStats* stats) {
+    const int n = static_cast<int>(fixed.size());
+    bool same_pattern = annotated;
+    for (int v = 0; v < n && same_pattern; ++v) {
+        int value = v < static_cast<int>(observed_values.size()) ? observed_values[v] : -1;
+        same_pattern = (value >= 0) == (fixed[v] >= 0);
+    }
+
+    if (same_pattern) {
+        // Stesse variabili osservate: il dtree resta annotato, si scartano solo le cache dei
+        // sottoalberi che menzionano una variabile il cui valore e' cambiato
+        for (int v = 0; v < n; ++v) {
+            int value = v < static_cast<int>(observed_values.size()) ? observed_values[v] : -1;
+            if (value == fixed[v]) continue;
+            fixed[v] = value;
+            assignment[v] = value;
+            for (int t : nodes_with_var[v]) {
+                std::fill(nodes[t].cache.begin(), nodes[t].cache.end(), -1.0);
+            }
+        }
+        return;
+    }
+
+    for (int v = 0; v < n; ++v) {
+        fixed[v] = v < static_cast<int>(observed_values.size()) ? observed_values[v] : -1;
+        assignment[v] = fixed[v]; // le osservate non sono in nessun cutset: restano istanziate
+    }
+    if (root >= 0) {
+        annotate(root, std::vector<int>(), 1.0, fixed);
+    }
+    allocateCaches(cache_budget, stats);
+    annotated = true;
+}
+
+double RecursiveConditioner::probabilityOfEvidence() {
+    return root >= 0 ? rc(root) : 1.0;
+}
+
+// Passo verso l'alto (rc, che riempie le cache) e poi verso il basso: P(e) e' multilineare nei
+// valori di ogni nodo, quindi P(X = x, e) si ottiene alla foglia di X dalla derivata di P(e)
+// rispetto al valore della foglia. Le derivate si accumulano per contesto nei nodi cachati
+// (visitati dall'alto in basso) e passano per ricorsione attraverso quelli non cachati.
+double RecursiveConditioner::differentiate(const std::vector<int>* families) {
+    for (std::vector<double>& table : joint) std::fill(table.begin(), table.end(), 0.0);
+    family_wanted.assign(joint.size(), 0);
+    family_joint.resize(joint.size());
+    if (families) {
+        for (int v : *families) {
+            family_wanted[v] = 1;
+            long long rows = 1;
+            for (int card : parent_cards[v]) rows *= card;
+            family_joint[v].assign(static_cast<size_t>(rows * cardinality[v]), 0.0);
+        }
+    }
+    if (root < 0) return 1.0;
+
+    double prob_evidence = rc(root);
+    if (prob_evidence <= 0.0) return prob_evidence;
+    for (int t : cached_nodes) std::fill(nodes[t].derivative.begin(), nodes[t].derivative.end(), 0.0);
+
+    propagate(root, 1.0);
+    for (int t : cached_nodes) {
+        const DtreeNode& node = nodes[t];
+        for (size_t key = 0; key < node.derivative.size(); ++key) {
+            if (node.derivative[key] == 0.0 || node.cache[key] == 0.0) continue;
+            for (size_t i = 0; i < node.context.size(); ++i) {
+                int v = node.context[i];
+                assignment[v] = static_cast<int>((static_cast<long long>(key) / node.context_strides[i]) % cardinality[v]);
+            }
+            propagateOverCutset(node, 0, node.derivative[key]);
+        }
+        for (int v : node.context) assignment[v] = fixed[v];
+    }
+    return prob_evidence;
+}
+
+// Derivata d entrante nel nodo t con l'istanziazione corrente del suo contesto
+void RecursiveConditioner::propagate(int t, double d) {
+    const DtreeNode& node = nodes[t];
+    if (node.family >= 0) {
+        differentiateLeaf(node, 0, d);
+        return;
+    }
+    if (!node.cache.empty()) {
+        long long key = 0;
+        for (size_t i = 0; i < node.context.size(); ++i) {
+            key += assignment[node.context[i]] * node.context_strides[i];
+        }
+        nodes[t].derivative[key] += d;
+        return;
+    }
+    propagateOverCutset(node, 0, d);
+}
+
+void RecursiveConditioner::propagateOverCutset(const DtreeNode& node, size_t k, double d) {
+    if (k == node.cutset.size()) {
+        // Un fattore nullo annulla tutti i contributi del ramo, anche quelli dell'altro figlio
+        double left = rc(node.left);
+        if (left == 0.0) return;
+        double right = rc(node.right);
+        if (right == 0.0) return;
+        propagate(node.left, d * right);
+        propagate(node.right, d * left);
+        return;
+    }
+
+    int v = node.cutset[k];
+    for (int value = 0; value < cardinality[v]; ++value) {
+        assignment[v] = value;
+        propagateOverCutset(node, k + 1, d);
+    }
+    assignment[v] = -1;
+}
+
+// Foglia: ogni istanziazione completa della famiglia contribuisce d * CPT a P(X = x, e)
+void RecursiveConditioner::differentiateLeaf(const DtreeNode& node, size_t k, double d) {
+    if (k == node.vars.size()) {
+        int v = node.family;
+        for (size_t i = 0; i < parent_ids[v].size(); ++i) {
+            parent_values[v][i] = assignment[parent_ids[v][i]];
+        }
+        double weight = d * getProbabilityFromParentValues(*variables[v], parent_values[v], parent_cards[v], assignment[v]);
+        joint[v][assignment[v]] += weight;
+        if (family_wanted[v]) {
+            long long row = 0;
+            for (size_t i = 0; i < parent_values[v].size(); ++i) {
+                row = row * parent_cards[v][i] + parent_values[v][i];
+            }
+            family_joint[v][row * cardinality[v] + assignment[v]] += weight;
+        }
+        return;
+    }
+
+    int v = node.vars[k];
+    if (assignment[v] >= 0) {
+        differentiateLeaf(node, k + 1, d);
+        return;
+    }
+    for (int value = 0; value < cardinality[v]; ++value) {
+        assignment[v] = value;
+        differentiateLeaf(node, k + 1, d);
+    }
+    assignment[v] = -1;
+}
+
+double RecursiveConditioner::rc(int t) {
+    ++calls;
+    const DtreeNode& node = nodes[t];
+    if (node.family >= 0) {
+        return evaluateLeaf(node, 0);
+    }
+
+    long long key = 0;
+    if (!node.cache.empty()) {
+        for (size_t i = 0; i < node.context.size(); ++i) {
+            key += assignment[node.context[i]] * node.context_strides[i];
+        }
+        if (node.cache[key] >= 0.0) {
+            return node.cache[key];
+        }
+    }
+
+    double result = sumOverCutset(node, 0);
+    if (!node.cache.empty()) {
+        nodes[t].cache[key] = result;
+    }
+    return result;
+}
+
+double RecursiveConditioner::sumOverCutset(const DtreeNode& node, size_t k) {
+    if (k == node.cutset.size()) {
+        double left = rc(node.left);
+        return left == 0.0 ? 0.0 : left * rc(node.right);
+    }
+
+    int v = node.cutset[k];
+    double total = 0.0;
+    for (int value = 0; value < cardinality[v]; ++value) {
+        assignment[v] = value;
+        total += sumOverCutset(node, k + 1);
+    }
+    assignment[v] = -1;
+    return total;
+}
+
+// Foglia: somma della CPT sulle variabili della famiglia non ancora istanziate
+// (di solito solo la variabile stessa, quando non compare in nessun'altra CPT).
+double RecursiveConditioner::evaluateLeaf(const DtreeNode& node, size_t k) {
+    if (k == node.vars.size()) {
+        int v = node.family;
+        for (size_t i = 0; i < parent_ids[v].size(); ++i) {
+            parent_values[v][i] = assignment[parent_ids[v][i]];
+        }
+        return getProbabilityFromParentValues(*variables[v], parent_values[v], parent_cards[v], assignment[v]);
+    }
+
+    int v = node.vars[k];
+    if (assignment[v] >= 0) {
+        return evaluateLeaf(node, k + 1);
+    }
+    double total = 0.0;
+    for (int value = 0; value < cardinality[v]; ++value) {
+        assignment[v] = value;
+        total += evaluateLeaf(node, k + 1);
+    }
+    assignment[v] = -1;
+    return total;
+}
+
+std::map<std::string, std::map<std::string, double>> calculateProbabilitiesWithRecursiveConditioning(
+    const BayesianNetwork& bn,
+    const Evidence& evidence,
+    long long cache_budget_bytes,
+    const std::string& query_variable,
+    RecursiveConditioningStats* stats
+) {
+    std::vector<int> observed = evidenceToValues(bn, evidence);
+    BayesianNetwork network = decomposeCompactCPTs(bn);
+    RecursiveConditioner conditioner(network, observed, cache_budget_bytes, stats);
+
+    // Un solo passo verso l'alto e uno verso il basso danno P(X = x, e) per tutte le variabili
+    double prob_evidence = conditioner.differentiate();
+
+    std::map<std::string, std::map<std::string, double>> marginal_probabilities;
+    for (const auto& pair : bn.variables) {
+        const Variable& var = pair.second;
+        if (!query_variable.empty() && var.name != query_variable && observed[var.id] < 0) continue;
+
+        for (size_t i = 0; i < var.values.size(); ++i) {
+            double probability;
+            if (observed[var.id] >= 0) {
+                // Variabili osservate: la distribuzione e' concentrata sul valore osservato
+                probability = static_cast<int>(i) == observed[var.id] ? 1.0 : 0.0;
+            } else {
+                probability = prob_evidence > 1e-300 ? conditioner.joint[var.id][i] / prob_evidence : 0.0;
+            }
+            marginal_probabilities[var.name][var.values[i]] = probability;
+        }
+    }
+
+    if (stats) {
+        stats->recursive_calls = conditioner.calls;
+    }
+    return marginal_probabilities;
+}
+
+RecursiveConditioningEngine::RecursiveConditioningEngine(const BayesianNetwork& bn, long long cache_budget_bytes)
+    : network(decomposeCompactCPTs(bn)),
+      conditioner(new RecursiveConditioner(network, std::vector<int>(bn.next_id, -1), cache_budget_bytes, nullptr)) {}
+
+RecursiveConditioningEngine::~RecursiveConditioningEngine() {}
+
+double RecursiveConditioningEngine::probabilityOfEvidence(const std::vector<int>& observed) {
+    conditioner->setEvidence(observed);
+    return conditioner->probabilityOfEvidence();
+}
+
+double RecursiveConditioningEngine::computeMarginals(
+    const std::vector<int>& observed,
+    const std::vector<int>& query_ids,
+    std::vector<std::vector<double>>& marginals
+) {
+    conditioner->setEvidence(observed);
+    double prob_evidence = conditioner->differentiate();
+    for (int id : query_ids) {
+        const int card = conditioner->cardinality[id];
+        marginals[id].assign(card, 0.0);
+        if (observed[id] >= 0) {
+            marginals[id][observed[id]] = 1.0;
+            continue;
+        }
+        for (int value = 0; value < card; ++value) {
+            marginals[id][value] = prob_evidence > 1e-300 ? conditioner->joint[id][value] / prob_evidence : 0.0;
+        }
+    }
+    return prob_evidence;
+}
+
+double RecursiveConditioningEngine::computeFamilyMarginals(
+    const std::vector<int>& observed,
+    const std::vector<int>& family_ids,
+    std::vector<std::vector<double>>& family_marginals
+) {
+    conditioner->setEvidence(observed);
+    double prob_evidence = conditioner->differentiate(&family_ids);
+    for (int id : family_ids) {
+        family_marginals[id] = conditioner->family_joint[id];
+        for (double& p : family_marginals[id]) {
+            p = prob_evidence > 1e-300 ? p / prob_evidence : 0.0;
+        }
+    }
+    return prob_evidence;
+}
@@ -0,0 +1,63 @@
+#ifndef RECURSIVE_CONDITIONING_H
+#define RECURSIVE_CONDITIONING_H
+
+#include "BayesianNetwork.h"
+#include <memory>
+
+// Statistics about the dtree and the caches chosen for the given memory budget
+struct RecursiveConditioningStats {
+    int dtree_nodes = 0;
+    int cached_nodes = 0;
+    long long cache_bytes = 0;          // memory actually reserved for the caches (values and derivatives)
+    long long full_cache_bytes = 0;     // memory needed to cache every internal node
+    long long recursive_calls = 0;      // total calls over all the runs of the query
+};
+
+// Exact inference by recursive conditioning over a dtree built from a min-fill elimination order
+// of decomposeCompactCPTs(bn): noisy-OR/MAX families enter the dtree as chains of small CPTs.
+// Observed variables never enter the cutsets and contexts. All the marginals come from one upward
+// pass and one downward (differentiation) pass over the dtree, whatever the number of variables.
+// cache_budget_bytes limits the memory used by the caches (0 = linear space, no caching).
+// If query_variable is not empty only its marginal (and the evidence) is returned.
+std::map<std::string, std::map<std::string, double>> calculateProbabilitiesWithRecursiveConditioning(
+    const BayesianNetwork& bn,
+    const Evidence& evidence,
+    long long cache_budget_bytes,
+    const std::string& query_variable = "",
+    RecursiveConditioningStats* stats = nullptr);
+
+struct RecursiveConditioner;
+
+// Total cache budget when none is given (--mem-limit): engines that run in parallel share it
+const long long DEFAULT_CACHE_BUDGET_BYTES = 1LL << 30;
+
+// Recursive conditioning engine reused across many queries on the same network (e.g. batch scoring):
+// the dtree is built once and annotated again only when the set of observed variables changes.
+// Between queries with the same observed variables the caches are kept, except those of the
+// subtrees that mention a variable whose value changed. Not thread-safe: use one engine per thread.
+class RecursiveConditioningEngine {
+public:
+    RecursiveConditioningEngine(const BayesianNetwork& bn, long long cache_budget_bytes);
+    ~RecursiveConditioningEngine();
+
+    // observed[id] = value index of each variable ID, -1 if not observed.
+    // Fills marginals[id][value] = P(X = value | e) for every ID in query_ids and returns P(e),
+    // with one differentiation pass however many variables are queried.
+    double computeMarginals(const std::vector<int>& observed, const std::vector<int>& query_ids,
+                            std::vector<std::vector<double>>& marginals);
+
+    // Fills family_marginals[id][row * card + value] = P(X = value, parents in row | e) for every ID in
+    // family_ids (rows ordered as in Variable::cpt) and returns P(e), in the same single pass.
+    // Families are those of decomposeCompactCPTs(bn): the ones of bn for every CPT that is not noisy or a tree.
+    double computeFamilyMarginals(const std::vector<int>& observed, const std::vector<int>& family_ids,
+                                  std::vector<std::vector<double>>& family_marginals);
+
+    // P(e) for the given observed values (same convention as computeMarginals)
+    double probabilityOfEvidence(const std::vector<int>& observed);
+
+private:
+    BayesianNetwork network;  // decomposed copy the conditioner refers to
+    std::unique_ptr<RecursiveConditioner> conditioner;
+};
+
+#endif // RECURSIVE_CONDITIONING_H
@@ -2,7 +2,17 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <cstdlib>
 #include "BayesianNetwork.h"
+#include "RecursiveConditioning.h"
+#include "BatchScoring.h"
+#include "Learning.h"
+#include "LoopCutset.h"
+#include "MiniBucket.h"
+#include "ModelRegistry.h"
+#include "PlanCache.h"
+#include <chrono>
+#include <thread>
 
 // --- Main function for testing ---
 int main(int argc, char* argv[]) {
@@ -12,6 +22,20 @@ int main(int argc, char* argv[]) {
     std::string filename = "";
     Evidence evidence;
     std::string query_variable_name = ""; // Optional: if you want to query a specific variable P(X|E)
+    std::string engine = "";              // "enumeration", "rc" (recursive conditioning), "cutset" or "minibucket"
+    long long mem_limit = -1;             // cache budget for recursive conditioning, -1 = DEFAULT_CACHE_BUDGET_BYTES
+    std::string score_file = "";          // score mode: CSV of cases to score
+    std::string output_file = "posteriors.csv";
+    ScoringOptions scoring_options;
+    std::string learn_file = "";          // learn mode: CSV of cases to estimate the CPTs from
+    std::string output_bif = "learned.bif";
+    LearningOptions learning_options;
+    MiniBucketOptions minibucket_options;
+    std::string registry_dir = "";        // model registry directory (e.g. on /dev/shm)
+    std::string publish_name = "";        // publish the network to the registry under this name
+    std::string model_name = "";          // query a published model instead of parsing a BIF file
+    std::string plan_cache_dir = "";      // persisted elimination plans, one file per network structure
+    double improve_plan_seconds = 0.0;    // seconds of randomized min-fill restarts before the query
 
     // Parse command line arguments for evidence and filename
     for (int i = 1; i < argc; ++i) {
@@ -28,6 +52,58 @@ int main(int argc, char* argv[]) {
         } else if (arg == "-q" && i + 1 < argc) { // Example for a query variable
             query_variable_name = trim(argv[++i]);
             std::cout << "Query variable: " << query_variable_name << std::endl;
+        } else if (arg == "--engine" && i + 1 < argc) {
+            engine = argv[++i];
+            std::cout << "Inference engine: " << engine << std::endl;
+        } else if (arg == "--mem-limit" && i + 1 < argc) {
+            mem_limit = parseMemorySize(argv[++i]);
+            if (mem_limit < 0) {
+                std::cerr << "Error: invalid memory limit " << argv[i] << std::endl;
+                return 1;
+            }
+            if (engine.empty()) {
+                engine = "rc"; // only recursive conditioning honours a memory budget
+            }
+            std::cout << "Memory limit: " << mem_limit << " bytes" << std::endl;
+        } else if (arg == "--score" && i + 1 < argc) {
+            score_file = argv[++i];
+        } else if (arg == "--out" && i + 1 < argc) {
+            output_file = argv[++i];
+        } else if (arg == "--threads" && i + 1 < argc) {
+            scoring_options.threads = std::atoi(argv[++i]);
+            learning_options.threads = scoring_options.threads;
+        } else if (arg == "--learn" && i + 1 < argc) {
+            learn_file = argv[++i];
+        } else if (arg == "--out-bif" && i + 1 < argc) {
+            output_bif = argv[++i];
+        } else if (arg == "--alpha" && i + 1 < argc) {
+            learning_options.alpha = std::atof(argv[++i]);
+        } else if (arg == "--em") {
+            learning_options.em = true;
+        } else if (arg == "--em-iterations" && i + 1 < argc) {
+            learning_options.em_iterations = std::atoi(argv[++i]);
+        } else if (arg == "--i-bound" && i + 1 < argc) {
+            minibucket_options.i_bound = std::atoi(argv[++i]);
+            if (engine.empty()) {
+                engine = "minibucket";
+            }
+        } else if (arg == "--time-budget" && i + 1 < argc) {
+            minibucket_options.time_budget = std::atof(argv[++i]);
+            if (engine.empty()) {
+                engine = "minibucket"; // anytime mode of mini-bucket elimination
+            }
+        } else if (arg == "--registry" && i + 1 < argc) {
+            registry_dir = argv[++i];
+        } else if (arg == "--publish" && i + 1 < argc) {
+            publish_name = argv[++i];
+        } else if (arg == "--model" && i + 1 < argc) {
+            model_name = argv[++i];
+        } else if (arg == "--plan-cache" && i + 1 < argc) {
+            plan_cache_dir = argv[++i];
+        } else if (arg == "--improve-plan" && i + 1 < argc) {
+            improve_plan_seconds = std::atof(argv[++i]);
+        } else if (arg == "--batch-size" && i + 1 < argc) {
+            scoring_options.batch_size = static_cast<size_t>(std::atoll(argv[++i]));
         } 
         // Add other argument parsing as needed (e.g., for different BIF files)
     }
@@ -35,6 +111,58 @@ int main(int argc, char* argv[]) {
         std::cout << std::endl;
     }
 
+    if ((!publish_name.empty() || !model_name.empty()) && registry_dir.empty()) {
+        std::cerr << "Error: --publish and --model need --registry <directory>" << std::endl;
+        return 1;
+    }
+
+    if (!model_name.empty()) {
+        // Model mode: the network is mapped read-only from the registry, nothing is parsed or copied
+        ModelRegistry registry(registry_dir);
+        std::shared_ptr<const SharedModel> model;
+        std::vector<double> posteriors;
+        double prob_evidence = 0.0;
+        // Se nel frattempo e' stata pubblicata un'epoca nuova (isStale) si risponde con quella
+        for (int attempt = 0; attempt < 3 && (!model || registry.isStale(*model)); ++attempt) {
+            model = registry.attach(model_name);
+            if (!model) {
+                std::vector<std::string> published = registry.list();
+                std::cerr << "Published models in " << registry_dir << ":";
+                for (const std::string& name : published) std::cerr << " " << name;
+                std::cerr << (published.empty() ? " none" : "") << std::endl;
+                return 1;
+            }
+            std::cout << "Attached model " << model_name << " (epoch " << model->epoch() << ", "
+                      << model->view().size << " variables, " << model->bytes() << " bytes)" << std::endl;
+
+            std::vector<EvidenceHandle> evidence_handles;
+            for (const auto& e_pair : evidence) {
+                int variable = model->variableHandle(e_pair.first);
+                int value = model->valueHandle(variable, e_pair.second);
+                if (variable < 0 || value < 0) {
+                    std::cerr << "Error: unknown evidence " << e_pair.first << " = " << e_pair.second << std::endl;
+                    return 1;
+                }
+                evidence_handles.push_back({variable, value});
+            }
+
+            EnumerationEngine engine(model->view());
+            posteriors.assign(model->view().posteriorSize(), 0.0);
+            prob_evidence = engine.query(evidence_handles.data(), evidence_handles.size(), posteriors.data());
+        }
+        std::cout << "P(e) = " << prob_evidence << std::endl;
+        std::cout << "\n--- Calculated Probabilities ---" << std::endl;
+        for (int x = 0; x < model->view().size; ++x) {
+            std::string var_name = model->variableName(x);
+            if ((!query_variable_name.empty() && var_name != query_variable_name) || evidence.count(var_name)) continue;
+            std::cout << "P(" << var_name << (evidence.empty() ? "" : " | E") << "):" << std::endl;
+            for (int v = 0; v < model->view().cardinality[x]; ++v) {
+                std::cout << "  " << model->valueName(x, v) << " -> " << posteriors[model->view().posterior_offset[x] + v] << std::endl;
+            }
+        }
+        return 0;
+    }
+
     // Create a dummy BIF file for testing
     std::ofstream outfile("gradient.bif");
     outfile << R"(network "GradientBN" {}
@@ -102,6 +230,81 @@ probability (e | a, c, d) {
         bn = parseBIF(filename); // Parsa il file di default
     }
 
+    if (!plan_cache_dir.empty() || improve_plan_seconds > 0.0) {
+        // Il piano viene caricato (o calcolato) una volta sola e riusato da RC e mini-bucket
+        setPlanCacheDirectory(plan_cache_dir);
+        BayesianNetwork plan_network = decomposeCompactCPTs(bn); // la rete su cui lavorano RC e mini-bucket
+        bool loaded = false;
+        EliminationPlan plan = getEliminationPlan(plan_network, &loaded);
+        std::cout << "Elimination plan " << plan.structure_hash << (loaded ? " loaded" : " computed")
+                  << ": width " << plan.width << ", cost " << plan.cost << " (" << plan.restarts << " restarts)" << std::endl;
+        if (improve_plan_seconds > 0.0) {
+            PlanImprover improver(plan_network);
+            improver.start();
+            std::this_thread::sleep_for(std::chrono::duration<double>(improve_plan_seconds));
+            improver.stop();
+            plan = getEliminationPlan(plan_network);
+            std::cout << "Plan search: " << improver.restarts() << " restarts, " << improver.improvements()
+                      << " improvements, width " << plan.width << ", cost " << plan.cost << std::endl;
+        }
+    }
+
+    if (!learn_file.empty()) {
+        // Learn mode: estimate the CPTs of the parsed structure and write them back as BIF
+        learning_options.mem_limit = mem_limit;
+        LearningStats learning_stats;
+        std::cout << "Learning parameters from " << learn_file << " (alpha " << learning_options.alpha
+                  << (learning_options.em ? ", EM" : "") << ")" << std::endl;
+        if (!learnParameters(bn, learn_file, learning_options, &learning_stats)) {
+            return 1;
+        }
+        std::cout << "Rows: " << learning_stats.rows << " (" << learning_stats.incomplete_rows << " with missing values, "
+                  << learning_stats.invalid_rows << " invalid) in " << learning_stats.seconds << " s" << std::endl;
+        if (learning_stats.em_iterations > 0) {
+            std::cout << "EM iterations: " << learning_stats.em_iterations << ", log-likelihood: " << learning_stats.log_likelihood << std::endl;
+        }
+        if (!writeBIF(bn, output_bif)) {
+            return 1;
+        }
+        std::cout << "Learned network written to " << output_bif << std::endl;
+        return 0;
+    }
+
+    if (!publish_name.empty()) {
+        ModelRegistry registry(registry_dir);
+        unsigned long long epoch = registry.publish(publish_name, bn);
+        if (epoch == 0) {
+            return 1;
+        }
+        std::cout << "Published " << filename << " as model " << publish_name << " (epoch " << epoch << ") in " << registry_dir << std::endl;
+        return 0;
+    }
+
+    if (!score_file.empty()) {
+        // Score mode: no per-network dump, just stream the case file through the engine
+        BayesianNetwork reordered_bn = reorder_network_topologically(bn, topological_sort(bn));
+        scoring_options.engine = engine.empty() ? "rc" : engine;
+        scoring_options.mem_limit = mem_limit;
+        std::stringstream ss(query_variable_name);
+        std::string name;
+        while (std::getline(ss, name, ',')) {
+            if (!trim(name).empty()) scoring_options.query_variables.push_back(trim(name));
+        }
+
+        ScoringStats scoring_stats;
+        std::cout << "Scoring " << score_file << " -> " << output_file << " (engine: " << scoring_options.engine << ")" << std::endl;
+        if (!scoreCaseFile(reordered_bn, score_file, output_file, scoring_options, &scoring_stats)) {
+            return 1;
+        }
+        std::cout << "Scored " << scoring_stats.rows << " rows in " << scoring_stats.batches << " batches ("
+                  << scoring_stats.invalid_rows << " invalid) in " << scoring_stats.seconds << " s";
+        if (scoring_stats.seconds > 0) {
+            std::cout << ", " << scoring_stats.rows / scoring_stats.seconds << " rows/s";
+        }
+        std::cout << std::endl;
+        return 0;
+    }
+
     // Print parsed data to verify
     std::cout << "--- Parsed Bayesian Network ---" << std::endl;
     for (const auto& pair : bn.variables) {
@@ -119,6 +322,11 @@ probability (e | a, c, d) {
             }
             std::cout << std::endl;
         }
+        if (var.cpt_kind != CPTKind::Dense) {
+            std::cout << "  CPT (" << getCPTKindName(var.cpt_kind) << ", " << var.cpt_params.size() << " parameters)" << std::endl;
+            std::cout << std::endl;
+            continue;
+        }
         std::cout << "  CPT:" << std::endl;
         for (const auto& row : var.cpt) {
             std::cout << "    ";
@@ -186,7 +394,77 @@ probability (e | a, c, d) {
 
 
     // Call a new or modified function to calculate probabilities with evidence
-    auto marginal_probabilities = calculateProbabilitiesWithEvidence(reordered_bn, evidence);
+    std::map<std::string, std::map<std::string, double>> marginal_probabilities;
+    if (engine.empty()) {
+        engine = "enumeration";
+    }
+    if (engine == "cutset") {
+        // Il numero di passi polytree si conosce prima di partire: oltre il limite si ripiega su rc
+        std::vector<int> cutset = find_loop_cutset(reordered_bn);
+        long long instantiations = countCutsetInstantiations(reordered_bn, cutset, evidenceToValues(reordered_bn, evidence),
+                                                             MAX_CUTSET_INSTANTIATIONS);
+        std::cout << "Loop cutset: " << cutset.size() << " of " << reordered_bn.next_id << " variables, ";
+        if (instantiations < 0) {
+            std::cout << "more than " << MAX_CUTSET_INSTANTIATIONS << " instantiations" << std::endl;
+            std::cerr << "Warning: the loop cutset is too large, using recursive conditioning instead" << std::endl;
+            engine = "rc";
+        } else {
+            std::cout << instantiations << " polytree passes" << std::endl;
+        }
+    }
+    if (engine == "rc") {
+        RecursiveConditioningStats rc_stats;
+        long long budget = mem_limit >= 0 ? mem_limit : DEFAULT_CACHE_BUDGET_BYTES;
+        marginal_probabilities = calculateProbabilitiesWithRecursiveConditioning(reordered_bn, evidence, budget, query_variable_name, &rc_stats);
+        std::cout << "--- Recursive Conditioning ---" << std::endl;
+        std::cout << "Dtree nodes: " << rc_stats.dtree_nodes << ", cached: " << rc_stats.cached_nodes
+                  << " (" << rc_stats.cache_bytes << " of " << rc_stats.full_cache_bytes << " bytes for full caching)" << std::endl;
+        std::cout << "Recursive calls: " << rc_stats.recursive_calls << std::endl;
+    } else if (engine == "cutset") {
+        LoopCutsetStats cutset_stats;
+        marginal_probabilities = calculateProbabilitiesWithLoopCutset(reordered_bn, evidence, scoring_options.threads, &cutset_stats);
+        std::cout << "--- Loop Cutset Conditioning ---" << std::endl;
+        std::cout << "Cutset (" << cutset_stats.cutset.size() << "):";
+        for (const std::string& name : cutset_stats.cutset) std::cout << " " << name;
+        std::cout << std::endl;
+        std::cout << "Instantiations: " << cutset_stats.instantiations << " on " << cutset_stats.threads << " threads" << std::endl;
+        std::cout << "P(e) = " << cutset_stats.prob_evidence << std::endl;
+    } else if (engine == "minibucket") {
+        MiniBucketStats minibucket_stats;
+        auto bounds = calculateProbabilitiesWithMiniBuckets(reordered_bn, evidence, minibucket_options, query_variable_name, &minibucket_stats);
+        std::cout << "--- Mini-Bucket Elimination ---" << std::endl;
+        if (minibucket_options.time_budget <= 0.0 && minibucket_options.i_bound < minibucket_stats.largest_family) {
+            std::cout << "i-bound raised from " << minibucket_options.i_bound << ": the largest CPT has "
+                      << minibucket_stats.largest_family << " variables" << std::endl;
+        }
+        if (minibucket_stats.runs == 0) {
+            std::cout << "No run completed within the time budget: trivial bounds" << std::endl;
+        }
+        std::cout << "i-bound: " << minibucket_stats.i_bound << " (" << minibucket_stats.runs << " runs in " << minibucket_stats.seconds << " s"
+                  << (minibucket_stats.exact ? ", exact" : "") << "), largest table: " << minibucket_stats.max_table_entries << " entries" << std::endl;
+        if (minibucket_stats.prob_evidence_known) {
+            std::cout << "P(e) ~ " << minibucket_stats.prob_evidence.estimate;
+        } else {
+            std::cout << "P(e) unknown";
+        }
+        std::cout << " in [" << minibucket_stats.prob_evidence.lower << ", " << minibucket_stats.prob_evidence.upper << "]" << std::endl;
+        for (const auto& var_entry : bounds) {
+            if (evidence.count(var_entry.first)) continue;
+            for (const auto& val_entry : var_entry.second) {
+                std::cout << "  P(" << var_entry.first << "=" << val_entry.first << ") in [" << val_entry.second.lower
+                          << ", " << val_entry.second.upper << "]" << std::endl;
+                marginal_probabilities[var_entry.first][val_entry.first] = val_entry.second.estimate;
+            }
+        }
+        for (const auto& e_pair : evidence) {
+            marginal_probabilities[e_pair.first][e_pair.second] = 1.0;
+        }
+    } else if (engine == "enumeration") {
+        marginal_probabilities = calculateProbabilitiesWithEvidence(reordered_bn, evidence);
+    } else {
+        std::cerr << "Error: unknown engine " << engine << " (use enumeration, rc, cutset or minibucket)" << std::endl;
+        return 1;
+    }
 
     // --- Print Results ---
     std::cout << "\n--- Calculated Probabilities ---" << std::endl;